@@ -43,8 +43,12 @@ class VPN {
   final _eventChannel = EventChannel("com.defyx.progress_events");
   final _crashEventChannel = EventChannel("com.defyx.crash_events");
 
+  // Linux batches progress lines into one list per frame; other platforms
+  // send them one string at a time.
   Stream<String> get vpnUpdates =>
-      _eventChannel.receiveBroadcastStream().map((event) => event.toString());
+      _eventChannel.receiveBroadcastStream().expand((event) => event is List
+          ? event.map((e) => e.toString())
+          : [event.toString()]);
 
   Stream<Map<dynamic, dynamic>> get crashUpdates =>
       _crashEventChannel.receiveBroadcastStream().cast<Map<dynamic, dynamic>>();
@@ -72,6 +76,11 @@ class VPN {
     vpnUpdates.listen((msg) {
       _handleVPNUpdates(msg);
     });
+    if (Platform.isLinux) {
+      _container?.read(connectionStateProvider.notifier).typedEvents.listen(
+            _handleVpnEvent,
+          );
+    }
 
     // Listen for Go crash events and report to Crashlytics
     crashUpdates.listen((crashData) {
@@ -111,6 +120,15 @@ class VPN {
   }
 
   void _handleVPNUpdates(String msg) {
+    if (Platform.isLinux) {
+      // State changes arrive as typed events (see _handleVpnEvent); the raw
+      // lines are only logged.
+      if (!msg.startsWith("Data: Firebase ")) {
+        log.addLog(msg);
+      }
+      return;
+    }
+
     final ref = _container!;
     final loggerNotifier = ref.read(loggerStateProvider.notifier);
     final groupNotifier = ref.read(groupStateProvider.notifier);
@@ -167,6 +185,48 @@ class VPN {
     log.addLog(msg);
   }
 
+  // Typed counterpart of _handleVPNUpdates; event names come from
+  // linux/runner/connection_event.cpp.
+  void _handleVpnEvent(Map<String, dynamic> event) {
+    final ref = _container!;
+    final loggerNotifier = ref.read(loggerStateProvider.notifier);
+    final groupNotifier = ref.read(groupStateProvider.notifier);
+    final value = event['value'] as int?;
+    final text = event['text'] as String? ?? '';
+
+    switch (event['name'] as String?) {
+      case 'configIndex':
+        if (value == null) return;
+        _setConnectionStep(value);
+        loggerNotifier.setConnecting();
+        if (value > 1) {
+          alertService.heartbeat();
+        }
+      case 'firebase':
+        _sendCoreFirebaseMessage(text);
+      case 'connected':
+        _onSuccessConnect();
+      case 'failed':
+        _onFailerConnect();
+      case 'cancelled':
+      case 'stopped':
+        _closeTunnel();
+      case 'groupFailed':
+        loggerNotifier.setSwitchingMethod();
+      case 'connecting':
+        _onLoading();
+      case 'configLabel':
+        _vpnBridge.setConnectionMethod(text);
+        groupNotifier.setGroupName(text);
+      case 'configTotal':
+        if (value != null) {
+          _setConnectionTotalSteps(value);
+        }
+      case 'serviceDestroyed':
+        _onTunnelClosed();
+    }
+  }
+
   void _handleCrashEvent(Map<dynamic, dynamic> crashData) {
     try {
       final functionName = crashData['functionName'] as String? ?? 'unknown';
@@ -11,6 +11,15 @@ class VpnBridge {
   Future<String?> getVpnStatus() async =>
       await _methodChannel.invokeMethod('getVpnStatus');
 
+  /// Linux only: returns `{seq, changed}` right away, plus `status` when it
+  /// changed after [seq]. Pass the last `seq` seen to poll cheaply.
+  Future<Map<dynamic, dynamic>> getStatusSince(int seq) async =>
+      (await _methodChannel.invokeMethod<Map<dynamic, dynamic>>(
+        'getStatusSince',
+        {"seq": seq},
+      )) ??
+      {};
+
   Future<void> setAsnName() async =>
       await _methodChannel.invokeMethod('setAsnName');
 
@@ -84,4 +93,40 @@ class VpnBridge {
 
   Future<bool> isVPNPrepared() async =>
       (await _methodChannel.invokeMethod<bool>('isVPNPrepared')) ?? false;
+
+  /// Linux only: native log entries newer than [sinceSeq], oldest first.
+  Future<Map<dynamic, dynamic>> getNativeLogs({
+    int sinceSeq = 0,
+    int maxCount = 500,
+    int minLevel = 0,
+  }) async =>
+      (await _methodChannel.invokeMethod<Map<dynamic, dynamic>>(
+        'getNativeLogs',
+        {"sinceSeq": sinceSeq, "maxCount": maxCount, "minLevel": minLevel},
+      )) ??
+      {};
+
+  /// Linux only: native counters, e.g. result cache hits and misses per call
+  /// and the size of each cache tier (`cacheTiers`).
+  Future<Map<dynamic, dynamic>> getNativeStats() async =>
+      (await _methodChannel.invokeMethod<Map<dynamic, dynamic>>(
+        'getNativeStats',
+      )) ??
+      {};
+
+  /// Linux only: Chrome trace-event JSON of connection attempt [id] (the
+  /// latest when 0). Open it in Perfetto to see where connect time went.
+  Future<String> dumpConnectTrace({int id = 0}) async =>
+      (await _methodChannel.invokeMethod<String>(
+        'dumpConnectTrace',
+        {"id": id},
+      )) ??
+      "";
+
+  /// Linux only: switches the native bridge to the core library at [path]
+  /// without restarting the app. Throws a [PlatformException] whose code says
+  /// why the reload was refused; the previous core stays loaded in that case.
+  Future<bool> reloadCore(String path) async =>
+      (await _methodChannel.invokeMethod<bool>('reloadCore', {"path": path})) ??
+      false;
 }
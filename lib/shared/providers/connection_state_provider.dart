@@ -50,6 +50,11 @@ class ConnectionStateNotifier extends StateNotifier<ConnectionState> {
 
   StreamSubscription? _eventSubscription;
 
+  // Linux also sends typed connection events on this channel; an event channel
+  // only supports one listener, so they are re-broadcast from here.
+  final _typedEvents = StreamController<Map<String, dynamic>>.broadcast();
+  Stream<Map<String, dynamic>> get typedEvents => _typedEvents.stream;
+
   ConnectionStateNotifier() : super(const ConnectionState()) {
     // Initialize VPN status listener first, then load saved state
     _initVpnStatusListener();
@@ -65,6 +70,11 @@ class ConnectionStateNotifier extends StateNotifier<ConnectionState> {
             event,
           );
 
+          if (statusEvent.containsKey('event')) {
+            _typedEvents.add(statusEvent);
+            return;
+          }
+
           // Check if this is a status event
           if (statusEvent.containsKey('status')) {
             final String vpnStatus = statusEvent['status'] as String;
@@ -150,6 +160,7 @@ class ConnectionStateNotifier extends StateNotifier<ConnectionState> {
   void dispose() {
     // Cancel the subscription when the notifier is disposed
     _eventSubscription?.cancel();
+    _typedEvents.close();
     super.dispose();
   }
 }
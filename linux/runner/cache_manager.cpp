@@ -0,0 +1,241 @@
+#include "cache_manager.h"
+
+#include <linux/magic.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <system_error>
+
+#include "defyx_logger.h"
+
+namespace cache_manager {
+namespace {
+
+constexpr uint64_t kMiB = 1024 * 1024;
+constexpr uint64_t kDefaultRuntimeLimit = 32 * kMiB;
+constexpr uint64_t kDefaultPersistentLimit = 256 * kMiB;
+
+struct TierState {
+  bool resolved = false;
+  TierStats stats;
+};
+
+std::mutex g_mutex;
+TierState g_tiers[2];
+std::string g_core_dir;
+
+TierState& State(Tier tier) {
+  return g_tiers[tier == Tier::kRuntime ? 0 : 1];
+}
+
+uint64_t LimitFromEnv(const char* name, uint64_t fallback) {
+  const char* value = std::getenv(name);
+  if (!value || !*value) return fallback;
+  char* end = nullptr;
+  unsigned long long mb = std::strtoull(value, &end, 10);
+  if (end == value || *end != '\0' || mb == 0) return fallback;
+  return static_cast<uint64_t>(mb) * kMiB;
+}
+
+bool OwnedDir(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == geteuid();
+}
+
+bool IsTmpfs(const std::string& path) {
+  struct statfs fs;
+  return statfs(path.c_str(), &fs) == 0 && fs.f_type == TMPFS_MAGIC;
+}
+
+std::string HomeDir() {
+  const char* home = std::getenv("HOME");
+  if (home && *home == '/') return home;
+  struct passwd* pw = getpwuid(getuid());
+  return pw && pw->pw_dir ? pw->pw_dir : "";
+}
+
+std::string ResolvePersistent() {
+  const char* xdg = std::getenv("XDG_CACHE_HOME");
+  std::string base;
+  if (xdg && *xdg == '/') {
+    base = xdg;
+  } else {
+    std::string home = HomeDir();
+    if (!home.empty()) base = home + "/.cache";
+  }
+  if (!base.empty() && EnsurePrivateDir(base + "/defyx")) return base + "/defyx";
+
+  // No usable home: a per-user directory in /tmp rather than a shared one.
+  std::string fallback = "/tmp/defyx-" + std::to_string(geteuid());
+  return EnsurePrivateDir(fallback) ? fallback : std::string();
+}
+
+std::string ResolveRuntime(const std::string& persistent) {
+  // The spec requires XDG_RUNTIME_DIR to be ours and 0700; don't use it if not.
+  const char* xdg = std::getenv("XDG_RUNTIME_DIR");
+  if (xdg && *xdg == '/' && OwnedDir(xdg)) {
+    std::string dir = std::string(xdg) + "/defyx";
+    if (EnsurePrivateDir(dir)) return dir;
+  }
+  if (persistent.empty()) return {};
+  std::string dir = persistent + "/runtime";
+  return EnsurePrivateDir(dir) ? dir : std::string();
+}
+
+// Must be called with g_mutex held.
+void ResolveLocked() {
+  TierState& persistent = State(Tier::kPersistent);
+  TierState& runtime = State(Tier::kRuntime);
+  if (persistent.resolved && runtime.resolved) return;
+
+  persistent.stats.name = "persistent";
+  persistent.stats.path = ResolvePersistent();
+  persistent.stats.limit_bytes = LimitFromEnv("DEFYX_CACHE_MAX_MB", kDefaultPersistentLimit);
+  persistent.stats.in_memory = !persistent.stats.path.empty() && IsTmpfs(persistent.stats.path);
+  persistent.resolved = true;
+
+  runtime.stats.name = "runtime";
+  runtime.stats.path = ResolveRuntime(persistent.stats.path);
+  runtime.stats.limit_bytes = LimitFromEnv("DEFYX_RUNTIME_CACHE_MAX_MB", kDefaultRuntimeLimit);
+  runtime.stats.in_memory = !runtime.stats.path.empty() && IsTmpfs(runtime.stats.path);
+  runtime.resolved = true;
+
+  if (!persistent.stats.path.empty() && EnsurePrivateDir(persistent.stats.path + "/core")) {
+    g_core_dir = persistent.stats.path + "/core";
+  }
+
+  defyx_log::Info("Cache tiers: runtime=", runtime.stats.path, runtime.stats.in_memory ? " (tmpfs)" : "",
+                  " persistent=", persistent.stats.path, " core=", g_core_dir);
+}
+
+struct CachedFile {
+  std::string path;
+  uint64_t size = 0;
+  int64_t last_use_ns = 0;
+};
+
+int64_t Nanos(const struct timespec& ts) {
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Regular files under |root|, skipping the directories in |exclude| (the
+// runtime fallback, trimmed on its own, and the core's directory, which is
+// never trimmed). Symlinks are neither followed nor counted.
+std::vector<CachedFile> ListFiles(const std::string& root, const std::vector<std::string>& exclude) {
+  std::vector<CachedFile> files;
+  std::error_code ec;
+  auto options = std::filesystem::directory_options::skip_permission_denied;
+  for (auto it = std::filesystem::recursive_directory_iterator(root, options, ec);
+       !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+    const std::string path = it->path().string();
+    if (std::find(exclude.begin(), exclude.end(), path) != exclude.end()) {
+      it.disable_recursion_pending();
+      continue;
+    }
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    CachedFile file;
+    file.path = path;
+    file.size = static_cast<uint64_t>(st.st_size);
+    file.last_use_ns = std::max(Nanos(st.st_atim), Nanos(st.st_mtim));
+    files.push_back(std::move(file));
+  }
+  return files;
+}
+
+}  // namespace
+
+std::string Dir(Tier tier) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  ResolveLocked();
+  return State(tier).stats.path;
+}
+
+std::string CoreDir() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  ResolveLocked();
+  return g_core_dir;
+}
+
+bool EnsurePrivateDir(const std::string& path) {
+  if (path.empty()) return false;
+  std::error_code ec;
+  bool created = std::filesystem::create_directories(path, ec);
+  if (ec || !OwnedDir(path)) {
+    defyx_log::Warn("Cache directory unusable: ", path, ec ? " (" + ec.message() + ")" : std::string());
+    return false;
+  }
+  // Directories left over from the shared /tmp days may be world-readable.
+  struct stat st;
+  if (created || (stat(path.c_str(), &st) == 0 && (st.st_mode & 077) != 0)) {
+    chmod(path.c_str(), 0700);
+  }
+  return true;
+}
+
+void Trim(Tier tier) {
+  std::string root;
+  std::vector<std::string> exclude;
+  uint64_t limit;
+  {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    ResolveLocked();
+    root = State(tier).stats.path;
+    limit = State(tier).stats.limit_bytes;
+    if (tier == Tier::kPersistent) {
+      for (const std::string& dir : {State(Tier::kRuntime).stats.path, g_core_dir}) {
+        if (!dir.empty()) exclude.push_back(dir);
+      }
+    }
+  }
+  if (root.empty()) return;
+
+  std::vector<CachedFile> files = ListFiles(root, exclude);
+  uint64_t total = 0;
+  for (const auto& file : files) total += file.size;
+
+  uint64_t evicted_files = 0;
+  uint64_t evicted_bytes = 0;
+  if (total > limit) {
+    std::sort(files.begin(), files.end(),
+              [](const CachedFile& a, const CachedFile& b) { return a.last_use_ns < b.last_use_ns; });
+    for (const auto& file : files) {
+      if (total <= limit) break;
+      if (unlink(file.path.c_str()) != 0) continue;
+      total -= file.size;
+      evicted_bytes += file.size;
+      ++evicted_files;
+    }
+    defyx_log::Info("Cache trim (", tier == Tier::kRuntime ? "runtime" : "persistent", "): evicted ",
+                    evicted_files, " files, ", evicted_bytes, " bytes; ", total, " of ", limit, " bytes in use");
+  }
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  TierStats& stats = State(tier).stats;
+  stats.bytes = total;
+  stats.files = files.size() - evicted_files;
+  stats.evicted_files += evicted_files;
+  stats.evicted_bytes += evicted_bytes;
+}
+
+void TrimAll() {
+  Trim(Tier::kRuntime);
+  Trim(Tier::kPersistent);
+}
+
+std::vector<TierStats> Stats() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  std::vector<TierStats> result;
+  for (const auto& state : g_tiers) {
+    if (state.resolved) result.push_back(state.stats);
+  }
+  return result;
+}
+
+}  // namespace cache_manager
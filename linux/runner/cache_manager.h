@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Owns the app's cache directories, in two tiers:
+//  - runtime: $XDG_RUNTIME_DIR/defyx, normally tmpfs, so its I/O stays in RAM
+//    and it is cleared at logout. For hot data nobody misses if it's gone.
+//  - persistent: $XDG_CACHE_HOME/defyx (~/.cache/defyx). Native caches that
+//    should survive a reboot, such as proxy_capabilities.cfg.
+// Both are created private to the user (0700). Each tier has a size cap and is
+// trimmed least-recently-used first; a file's last use is the newer of its
+// access and modification times. The core's own directory, <persistent>/core,
+// is never trimmed: the core may hold its files open and doesn't expect them
+// to disappear.
+namespace cache_manager {
+
+enum class Tier {
+  kRuntime,
+  kPersistent,
+};
+
+// Directory for |tier|, resolved and created on first use. The runtime tier
+// falls back to <persistent>/runtime when XDG_RUNTIME_DIR is unset or unusable.
+// Empty only if no directory could be created at all.
+std::string Dir(Tier tier);
+
+// The directory handed to the core with SetCacheDir and StartVPN:
+// <persistent>/core. Empty if it could not be created.
+std::string CoreDir();
+
+// Creates |path| and its missing parents with mode 0700. Returns false if it
+// does not exist afterwards or belongs to another user.
+bool EnsurePrivateDir(const std::string& path);
+
+// Deletes least recently used files until |tier| is under its cap
+// (DEFYX_RUNTIME_CACHE_MAX_MB / DEFYX_CACHE_MAX_MB, default 32 and 256 MiB),
+// then records its usage for Stats(). CoreDir() is neither counted nor
+// trimmed. Walks the tree; call off the main thread.
+void Trim(Tier tier);
+void TrimAll();
+
+struct TierStats {
+  const char* name = "";  // "runtime" or "persistent"
+  std::string path;
+  bool in_memory = false;  // backed by tmpfs
+  uint64_t bytes = 0;
+  uint64_t files = 0;
+  uint64_t limit_bytes = 0;
+  uint64_t evicted_files = 0;  // since startup
+  uint64_t evicted_bytes = 0;
+};
+
+// Usage as of the last Trim of each tier. Cheap; safe on the main thread.
+std::vector<TierStats> Stats();
+
+}  // namespace cache_manager
@@ -0,0 +1,256 @@
+#include "connect_trace.h"
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "defyx_logger.h"
+
+namespace connect_trace {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kEventsPerThread = 2048;
+// Rings of threads that have exited are dropped beyond this many.
+constexpr size_t kMaxBuffers = 64;
+
+struct Event {
+  const char* name = nullptr;
+  const char* category = nullptr;
+  char phase = 'i';
+  uint64_t session = 0;
+  int64_t ts_us = 0;
+  int64_t dur_us = 0;
+  std::string detail;
+};
+
+struct ThreadBuffer {
+  std::mutex mutex;
+  uint32_t tid = 0;
+  std::string thread_name;
+  std::vector<Event> ring;
+  size_t next = 0;
+  bool wrapped = false;
+  std::atomic<bool> alive{true};
+
+  void Add(Event event) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ring.size() < kEventsPerThread) {
+      ring.push_back(std::move(event));
+      return;
+    }
+    ring[next] = std::move(event);
+    next = (next + 1) % kEventsPerThread;
+    wrapped = true;
+  }
+};
+
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>>& Registry() {
+  static auto* buffers = new std::vector<std::shared_ptr<ThreadBuffer>>();
+  return *buffers;
+}
+
+std::atomic<uint64_t> g_next_session{0};
+// The attempt events are recorded for; 0 between EndSession and the next
+// BeginSession, when nothing is recorded.
+std::atomic<uint64_t> g_active_session{0};
+// What DumpJson(0) returns once the attempt has ended.
+std::atomic<uint64_t> g_last_session{0};
+const Clock::time_point g_epoch = Clock::now();
+
+int64_t MicrosSinceEpoch(Clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(t - g_epoch).count();
+}
+
+// Flags the ring as dead when its thread exits so the registry can drop it.
+struct BufferHandle {
+  std::shared_ptr<ThreadBuffer> buffer;
+  ~BufferHandle() {
+    if (buffer) buffer->alive.store(false, std::memory_order_relaxed);
+  }
+};
+
+ThreadBuffer& LocalBuffer() {
+  thread_local BufferHandle handle;
+  if (!handle.buffer) {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    char name[32] = {};
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) buffer->thread_name = name;
+    buffer->ring.reserve(64);
+
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    auto& registry = Registry();
+    if (registry.size() >= kMaxBuffers) {
+      registry.erase(std::remove_if(registry.begin(), registry.end(),
+                                    [](const std::shared_ptr<ThreadBuffer>& b) {
+                                      return !b->alive.load(std::memory_order_relaxed);
+                                    }),
+                     registry.end());
+    }
+    registry.push_back(buffer);
+    handle.buffer = std::move(buffer);
+  }
+  return *handle.buffer;
+}
+
+void AppendEscaped(std::string* out, const std::string& text) {
+  for (unsigned char c : text) {
+    switch (c) {
+      case '"': *out += "\\\""; break;
+      case '\\': *out += "\\\\"; break;
+      case '\n': *out += "\\n"; break;
+      case '\r': *out += "\\r"; break;
+      case '\t': *out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          *out += buf;
+        } else {
+          *out += static_cast<char>(c);
+        }
+    }
+  }
+}
+
+}  // namespace
+
+uint64_t BeginSession() {
+  uint64_t id = g_next_session.fetch_add(1, std::memory_order_relaxed) + 1;
+  g_last_session.store(id, std::memory_order_relaxed);
+  g_active_session.store(id, std::memory_order_relaxed);
+  Instant("session.begin", "session");
+  return id;
+}
+
+void EndSession(const char* outcome) {
+  // Only the first outcome ends an attempt; later stopped/failed lines find
+  // nothing active.
+  uint64_t id = g_active_session.exchange(0, std::memory_order_relaxed);
+  if (id == 0) return;
+  Event event;
+  event.name = "session.end";
+  event.category = "session";
+  event.session = id;
+  event.ts_us = MicrosSinceEpoch(Clock::now());
+  event.detail = outcome ? outcome : "";
+  LocalBuffer().Add(std::move(event));
+
+  const char* dir = std::getenv("DEFYX_TRACE_DIR");
+  if (!dir || !*dir) return;
+  std::string path = std::string(dir) + "/connect-" + std::to_string(id) + ".json";
+  std::ofstream out(path, std::ios::trunc);
+  out << DumpJson(id);
+  if (out) {
+    defyx_log::Info("Connect trace ", id, " written to ", path);
+  } else {
+    defyx_log::Warn("Could not write connect trace to ", path);
+  }
+}
+
+uint64_t CurrentSession() {
+  return g_active_session.load(std::memory_order_relaxed);
+}
+
+void Instant(const char* name, const char* category, const std::string& detail) {
+  uint64_t session = CurrentSession();
+  if (session == 0) return;
+  Event event;
+  event.name = name;
+  event.category = category;
+  event.phase = 'i';
+  event.session = session;
+  event.ts_us = MicrosSinceEpoch(Clock::now());
+  event.detail = detail;
+  LocalBuffer().Add(std::move(event));
+}
+
+Span::Span(const char* name, const char* category)
+    : name_(name), category_(category), session_(CurrentSession()), start_(Clock::now()) {}
+
+Span::~Span() {
+  if (session_ == 0) return;
+  Event event;
+  event.name = name_;
+  event.category = category_;
+  event.phase = 'X';
+  event.session = session_;
+  event.ts_us = MicrosSinceEpoch(start_);
+  event.dur_us = MicrosSinceEpoch(Clock::now()) - event.ts_us;
+  LocalBuffer().Add(std::move(event));
+}
+
+std::string DumpJson(uint64_t id) {
+  if (id == 0) id = g_last_session.load(std::memory_order_relaxed);
+
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    buffers = Registry();
+  }
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"connectionId\":" +
+                    std::to_string(id) + "},\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&]() {
+    if (!first) out += ',';
+    first = false;
+  };
+  const std::string pid = std::to_string(getpid());
+
+  for (const auto& buffer : buffers) {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    bool named = false;
+    size_t count = buffer->ring.size();
+    size_t start = buffer->wrapped ? buffer->next : 0;
+    for (size_t i = 0; i < count; ++i) {
+      const Event& event = buffer->ring[(start + i) % count];
+      if (event.session != id) continue;
+      if (!named && !buffer->thread_name.empty()) {
+        separator();
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" +
+               std::to_string(buffer->tid) + ",\"args\":{\"name\":\"";
+        AppendEscaped(&out, buffer->thread_name);
+        out += "\"}}";
+        named = true;
+      }
+      separator();
+      out += "{\"name\":\"";
+      AppendEscaped(&out, event.name);
+      out += "\",\"cat\":\"";
+      AppendEscaped(&out, event.category);
+      out += "\",\"ph\":\"";
+      out += event.phase;
+      out += "\",\"ts\":" + std::to_string(event.ts_us);
+      if (event.phase == 'X') {
+        out += ",\"dur\":" + std::to_string(event.dur_us);
+      } else {
+        out += ",\"s\":\"t\"";
+      }
+      out += ",\"pid\":" + pid + ",\"tid\":" + std::to_string(buffer->tid);
+      out += ",\"args\":{\"conn\":" + std::to_string(event.session);
+      if (!event.detail.empty()) {
+        out += ",\"detail\":\"";
+        AppendEscaped(&out, event.detail);
+        out += '"';
+      }
+      out += "}}";
+    }
+  }
+  out += "]}";
+  return out;
+}
+
+}  // namespace connect_trace
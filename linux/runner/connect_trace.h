@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Per-connect timeline of what the native side did, exportable as Chrome
+// trace-event JSON (open in Perfetto or chrome://tracing). Each thread records
+// into its own small ring, so recording takes only that ring's uncontended
+// lock; the rings are merged only when a trace is dumped. Events are only
+// recorded while an attempt is active, and each carries that attempt's ID.
+namespace connect_trace {
+
+// Starts a new connection attempt and returns its ID. Events recorded from
+// now on belong to it until EndSession or the next BeginSession.
+uint64_t BeginSession();
+// Marks the active attempt as finished (connected, failed or stopped); a no-op
+// when none is active. When DEFYX_TRACE_DIR is set, also writes the trace
+// there as connect-<id>.json, which is file I/O.
+void EndSession(const char* outcome);
+// The active attempt, or 0 if there is none.
+uint64_t CurrentSession();
+
+// A point in time, e.g. a progress line or a status change. |detail| shows up
+// under args in the viewer.
+void Instant(const char* name, const char* category, const std::string& detail = {});
+
+// Records the time between construction and destruction as one complete
+// event. |name| and |category| must outlive the span (string literals).
+class Span {
+ public:
+  Span(const char* name, const char* category);
+  ~Span();
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+ private:
+  const char* name_;
+  const char* category_;
+  uint64_t session_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Trace-event JSON for session |id| (0 = the most recent one, even if it has
+// ended).
+std::string DumpJson(uint64_t id = 0);
+
+}  // namespace connect_trace
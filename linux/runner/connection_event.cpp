@@ -0,0 +1,116 @@
+#include "connection_event.h"
+
+namespace connection_event {
+namespace {
+
+constexpr std::string_view kDataPrefix = "Data: ";
+constexpr std::string_view kServiceDestroyed = "VPN Service Destroyed";
+
+bool ConsumePrefix(std::string_view* line, std::string_view prefix) {
+  if (line->substr(0, prefix.size()) != prefix) {
+    return false;
+  }
+  line->remove_prefix(prefix.size());
+  return true;
+}
+
+int64_t ParseCount(std::string_view digits) {
+  if (digits.empty()) {
+    return -1;
+  }
+  int64_t value = 0;
+  for (char c : digits) {
+    if (c < '0' || c > '9' || value > (INT64_MAX - 9) / 10) {
+      return -1;
+    }
+    value = value * 10 + (c - '0');
+  }
+  return value;
+}
+
+Event Make(Code code) {
+  Event event;
+  event.code = code;
+  return event;
+}
+
+Event ClassifyVpn(std::string_view rest) {
+  if (rest.empty()) {
+    return {};
+  }
+  switch (rest[0]) {
+    case 'c':
+      if (ConsumePrefix(&rest, "connect")) {
+        if (rest.substr(0, 2) == "ed") return Make(Code::kConnected);
+        if (rest.substr(0, 3) == "ing") return Make(Code::kConnecting);
+      } else if (rest.substr(0, 9) == "cancelled") {
+        return Make(Code::kCancelled);
+      }
+      return {};
+    case 'f':
+      return rest.substr(0, 6) == "failed" ? Make(Code::kFailed) : Event{};
+    case 'g':
+      return rest.substr(0, 12) == "group failed" ? Make(Code::kGroupFailed) : Event{};
+    case 's':
+      return rest.substr(0, 7) == "stopped" ? Make(Code::kStopped) : Event{};
+    default:
+      return {};
+  }
+}
+
+Event ClassifyConfig(std::string_view rest) {
+  Event event;
+  if (ConsumePrefix(&rest, "index: ")) {
+    event.code = Code::kConfigIndex;
+    event.value = ParseCount(rest);
+  } else if (ConsumePrefix(&rest, "Numbers: ")) {
+    event.code = Code::kConfigTotal;
+    event.value = ParseCount(rest);
+  } else if (ConsumePrefix(&rest, "label: ")) {
+    event.code = Code::kConfigLabel;
+    event.text = rest;
+  }
+  return event;
+}
+
+}  // namespace
+
+Event Classify(std::string_view line) {
+  if (!ConsumePrefix(&line, kDataPrefix)) {
+    // Service notices aren't "Data:" lines and may carry any prefix.
+    return line.find(kServiceDestroyed) != std::string_view::npos ? Make(Code::kServiceDestroyed)
+                                                                  : Event{};
+  }
+  if (ConsumePrefix(&line, "VPN ")) {
+    return ClassifyVpn(line);
+  }
+  if (ConsumePrefix(&line, "Config ")) {
+    return ClassifyConfig(line);
+  }
+  if (ConsumePrefix(&line, "Firebase ")) {
+    Event event = Make(Code::kFirebase);
+    event.text = line;
+    return event;
+  }
+  return {};
+}
+
+const char* Name(Code code) {
+  switch (code) {
+    case Code::kNone: return "none";
+    case Code::kConnecting: return "connecting";
+    case Code::kConnected: return "connected";
+    case Code::kFailed: return "failed";
+    case Code::kGroupFailed: return "groupFailed";
+    case Code::kStopped: return "stopped";
+    case Code::kCancelled: return "cancelled";
+    case Code::kConfigIndex: return "configIndex";
+    case Code::kConfigTotal: return "configTotal";
+    case Code::kConfigLabel: return "configLabel";
+    case Code::kFirebase: return "firebase";
+    case Code::kServiceDestroyed: return "serviceDestroyed";
+  }
+  return "none";
+}
+
+}  // namespace connection_event
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Typed form of the core's "Data: ..." progress lines. The codes are sent to
+// Flutter as-is on com.defyx.vpn_events, so only ever append to this list.
+namespace connection_event {
+
+enum class Code : int {
+  kNone = 0,              // not a state line; only goes to the log stream
+  kConnecting = 1,        // "Data: VPN connecting"
+  kConnected = 2,         // "Data: VPN connected"
+  kFailed = 3,            // "Data: VPN failed"
+  kGroupFailed = 4,       // "Data: VPN group failed"
+  kStopped = 5,           // "Data: VPN stopped"
+  kCancelled = 6,         // "Data: VPN cancelled"
+  kConfigIndex = 7,       // "Data: Config index: <n>"       -> value
+  kConfigTotal = 8,       // "Data: Config Numbers: <n>"     -> value
+  kConfigLabel = 9,       // "Data: Config label: <label>"   -> text
+  kFirebase = 10,         // "Data: Firebase <payload>"      -> text
+  kServiceDestroyed = 11, // "... VPN Service Destroyed ..."
+};
+
+struct Event {
+  Code code = Code::kNone;
+  // Numeric payload for kConfigIndex/kConfigTotal, -1 if it didn't parse.
+  int64_t value = -1;
+  // Text payload for kConfigLabel/kFirebase; points into the classified line.
+  std::string_view text;
+};
+
+// Looks at each byte of |line| at most once: a fixed prefix check, then a
+// switch on the first distinguishing character.
+Event Classify(std::string_view line);
+
+// Stable camelCase name for |code|, e.g. "groupFailed".
+const char* Name(Code code);
+
+}  // namespace connection_event
@@ -0,0 +1,35 @@
+#include "core_prewarm.h"
+
+#include <chrono>
+#include <thread>
+
+#include "cache_manager.h"
+#include "defyx_core.h"
+#include "defyx_core_cache.h"
+#include "defyx_logger.h"
+
+namespace defyx_core {
+
+void StartPrewarm() {
+  std::thread([]() {
+    auto start = std::chrono::steady_clock::now();
+    if (!LoadCoreDll("")) {
+      defyx_log::Warn("Prewarm: libDXcore.so not found; core calls will retry on demand");
+      return;
+    }
+    auto loaded = std::chrono::steady_clock::now();
+
+    SetCacheDir(cache_manager::CoreDir());
+    CachedGetCachedFlowLine();
+
+    auto done = std::chrono::steady_clock::now();
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    defyx_log::Info("Prewarm: core loaded in ", duration_cast<milliseconds>(loaded - start).count(),
+                    " ms, cached flowline ready after ", duration_cast<milliseconds>(done - start).count(), " ms");
+
+    cache_manager::TrimAll();
+  }).detach();
+}
+
+}  // namespace defyx_core
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace defyx_core {
+
+// Loads libDXcore.so, points it at the persistent cache tier and fills the
+// cached-flowline result on a detached thread, so neither the first frame nor
+// the first connect waits on dlopen or the core's disk read; then trims both
+// cache tiers. Call once at startup, before the Flutter view is created. Core
+// calls that arrive first still work: they lazy-load the library themselves
+// and the prewarm then finds it loaded.
+void StartPrewarm();
+
+}  // namespace defyx_core
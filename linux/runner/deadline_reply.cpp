@@ -0,0 +1,79 @@
+#include "deadline_reply.h"
+
+#include <utility>
+
+namespace {
+
+void DeleteReplyRef(gpointer data) {
+  delete static_cast<std::shared_ptr<DeadlineReply>*>(data);
+}
+
+struct Completion {
+  std::shared_ptr<DeadlineReply> reply;
+  FlValue* value;
+};
+
+}  // namespace
+
+std::shared_ptr<DeadlineReply> DeadlineReply::Start(FlMethodCall* method_call, guint timeout_ms,
+                                                    FlValue* fallback, DeadlineCounters* counters) {
+  std::shared_ptr<DeadlineReply> reply(new DeadlineReply(method_call, fallback, counters));
+  // The timeout source holds its own reference so the reply outlives a
+  // worker that is slow to finish.
+  reply->timeout_id_ = g_timeout_add_full(G_PRIORITY_DEFAULT, timeout_ms, OnDeadline,
+                                          new std::shared_ptr<DeadlineReply>(reply), DeleteReplyRef);
+  return reply;
+}
+
+DeadlineReply::DeadlineReply(FlMethodCall* method_call, FlValue* fallback,
+                             DeadlineCounters* counters)
+    : method_call_(FL_METHOD_CALL(g_object_ref(method_call))),
+      fallback_(fallback),
+      counters_(counters) {}
+
+DeadlineReply::~DeadlineReply() {
+  if (fallback_) fl_value_unref(fallback_);
+  g_object_unref(method_call_);
+}
+
+void DeadlineReply::Complete(std::shared_ptr<DeadlineReply> reply, FlValue* value) {
+  g_idle_add(OnComplete, new Completion{std::move(reply), value});
+}
+
+gboolean DeadlineReply::OnDeadline(gpointer user_data) {
+  DeadlineReply* self = static_cast<std::shared_ptr<DeadlineReply>*>(user_data)->get();
+  self->timeout_id_ = 0;
+  if (!self->answered_) {
+    self->counters_->missed.fetch_add(1, std::memory_order_relaxed);
+    self->Respond(self->fallback_);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+gboolean DeadlineReply::OnComplete(gpointer user_data) {
+  auto* completion = static_cast<Completion*>(user_data);
+  DeadlineReply* self = completion->reply.get();
+  if (self->answered_) {
+    self->counters_->late.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    self->counters_->on_time.fetch_add(1, std::memory_order_relaxed);
+    if (self->timeout_id_ != 0) {
+      g_source_remove(self->timeout_id_);
+      self->timeout_id_ = 0;
+    }
+    self->Respond(completion->value);
+  }
+  fl_value_unref(completion->value);
+  delete completion;
+  return G_SOURCE_REMOVE;
+}
+
+void DeadlineReply::Respond(FlValue* value) {
+  answered_ = true;
+  g_autoptr(FlMethodResponse) response =
+      FL_METHOD_RESPONSE(fl_method_success_response_new(value));
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(method_call_, response, &error)) {
+    g_warning("Failed to send Flutter response: %s", error ? error->message : "unknown error");
+  }
+}
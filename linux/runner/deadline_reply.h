@@ -0,0 +1,47 @@
+#pragma once
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Outcome counters for one kind of deadline-bound method call.
+struct DeadlineCounters {
+  std::atomic<uint64_t> on_time{0};  // answered with the real result
+  std::atomic<uint64_t> missed{0};   // answered with the default at the deadline
+  std::atomic<uint64_t> late{0};     // results discarded because they came too late
+};
+
+// Answers a method call exactly once: with the worker's result if it arrives
+// before the deadline, otherwise with a default when the deadline fires. The
+// worker keeps running after a miss; its result is then dropped (anything it
+// cached along the way still serves the next call).
+class DeadlineReply {
+ public:
+  // Main thread only. Takes a reference on |method_call| and ownership of
+  // |fallback|, which is sent if Complete has not happened within |timeout_ms|.
+  static std::shared_ptr<DeadlineReply> Start(FlMethodCall* method_call, guint timeout_ms,
+                                              FlValue* fallback, DeadlineCounters* counters);
+
+  ~DeadlineReply();
+
+  DeadlineReply(const DeadlineReply&) = delete;
+  DeadlineReply& operator=(const DeadlineReply&) = delete;
+
+  // Any thread. Takes ownership of |value| and delivers it on the main loop.
+  static void Complete(std::shared_ptr<DeadlineReply> reply, FlValue* value);
+
+ private:
+  DeadlineReply(FlMethodCall* method_call, FlValue* fallback, DeadlineCounters* counters);
+
+  static gboolean OnDeadline(gpointer user_data);
+  static gboolean OnComplete(gpointer user_data);
+  void Respond(FlValue* value);
+
+  FlMethodCall* method_call_;
+  FlValue* fallback_;
+  DeadlineCounters* counters_;
+  guint timeout_id_ = 0;
+  bool answered_ = false;
+};
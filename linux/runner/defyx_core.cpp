@@ -1,12 +1,22 @@
 #include "defyx_core.h"
+#include "cache_manager.h"
+#include "connect_trace.h"
+#include "defyx_logger.h"
+#include "main_thread.h"
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <type_traits>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <filesystem>
 #include <vector>
 #include <dlfcn.h>
+#include <link.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
 
@@ -32,28 +42,94 @@ typedef void (*dx_set_cache_dir_fn)(const char*);
 typedef int (*dx_is_tunnel_running_fn)();
 }
 
-static void* g_dx_dll = nullptr;
+// Every export resolved from one libDXcore.so handle. A table is built once per
+// load, published through g_api and never mutated afterwards; callers pin it
+// with an ApiLease for the duration of a call.
+struct DxCoreApi {
+  void* handle = nullptr;
+  std::string path;
+  // Build identity of the library, see LibraryVersion.
+  std::string version;
+  dx_start_vpn_fn start_vpn = nullptr;
+  dx_stop_vpn_fn stop_vpn = nullptr;
+  dx_start_t2s_fn start_t2s = nullptr;
+  dx_stop_t2s_fn stop_t2s = nullptr;
+  dx_stop_fn stop_all = nullptr;
+  dx_measure_ping_fn measure_ping = nullptr;
+  dx_get_flag_fn get_flag = nullptr;
+  dx_set_asn_name_fn set_asn_name = nullptr;
+  dx_set_timezone_fn set_timezone = nullptr;
+  dx_get_flowline_fn get_flowline = nullptr;
+  dx_get_cached_flowline_fn get_cached_flowline = nullptr;
+  dx_decode_verify_flowline_fn decode_verify_flowline = nullptr;
+  dx_get_vpn_status_fn get_vpn_status = nullptr;
+  dx_set_progress_callback_fn set_progress_cb = nullptr;
+  dx_set_verbose_logging_fn set_verbose = nullptr;
+  dx_free_string_fn free_string = nullptr;
+  dx_set_connection_method_fn set_connection_method = nullptr;
+  dx_set_cache_dir_fn set_cache_dir = nullptr;
+  dx_is_tunnel_running_fn is_tunnel_running = nullptr;
+
+  // Calls currently running through this table.
+  mutable std::atomic<int> in_flight{0};
+};
+
+static std::atomic<const DxCoreApi*> g_api{nullptr};
+// Serialises load/unload; never taken on the call path.
 static std::mutex g_dx_mutex;
-static std::mutex g_log_mutex;
-static dx_start_vpn_fn g_start_vpn = nullptr;
-static dx_stop_vpn_fn g_stop_vpn = nullptr;
-static dx_start_t2s_fn g_start_t2s = nullptr;
-static dx_stop_t2s_fn g_stop_t2s = nullptr;
-static dx_stop_fn g_stop_all = nullptr;
-static dx_measure_ping_fn g_measure_ping = nullptr;
-static dx_get_flag_fn g_get_flag = nullptr;
-static dx_set_asn_name_fn g_set_asn_name = nullptr;
-static dx_set_timezone_fn g_set_timezone = nullptr;
-static dx_get_flowline_fn g_get_flowline = nullptr;
-static dx_get_cached_flowline_fn g_get_cached_flowline = nullptr;
-static dx_decode_verify_flowline_fn g_decode_verify_flowline = nullptr;
-static dx_get_vpn_status_fn g_get_vpn_status = nullptr;
-static dx_set_progress_callback_fn g_set_progress_cb = nullptr;
-static dx_set_verbose_logging_fn g_set_verbose = nullptr;
-static dx_free_string_fn g_free_string = nullptr;
-static dx_set_connection_method_fn g_set_connection_method = nullptr;
-static dx_set_cache_dir_fn g_set_cache_dir = nullptr;
-static dx_is_tunnel_running_fn g_is_tunnel_running = nullptr;
+// Unpublished tables are kept for the life of the process so a racing
+// ApiLease can still touch in_flight safely. Their libraries stay mapped too:
+// the core is a Go c-shared library, and its runtime threads keep running in
+// it after the last call returns, so it can never be dlclose'd.
+static std::vector<std::unique_ptr<DxCoreApi>> g_retired_apis;
+
+// Pins the currently published table. Costs one acquire load plus an
+// increment/decrement of the table's in-flight counter.
+class ApiLease {
+ public:
+  ApiLease() : api_(Acquire()) {}
+  ~ApiLease() { Release(); }
+
+  ApiLease(ApiLease&& other) noexcept : api_(other.api_) { other.api_ = nullptr; }
+  ApiLease& operator=(ApiLease&& other) noexcept {
+    if (this != &other) {
+      Release();
+      api_ = other.api_;
+      other.api_ = nullptr;
+    }
+    return *this;
+  }
+  ApiLease(const ApiLease&) = delete;
+  ApiLease& operator=(const ApiLease&) = delete;
+
+  explicit operator bool() const { return api_ != nullptr; }
+  const DxCoreApi* operator->() const { return api_; }
+  const DxCoreApi* get() const { return api_; }
+
+ private:
+  static const DxCoreApi* Acquire() {
+    const DxCoreApi* api = g_api.load(std::memory_order_acquire);
+    while (api) {
+      api->in_flight.fetch_add(1, std::memory_order_seq_cst);
+      // Pairs with the exchange in UnloadCoreDll: either the unloader sees our
+      // increment, or we see that the table has been unpublished.
+      const DxCoreApi* current = g_api.load(std::memory_order_seq_cst);
+      if (current == api) return api;
+      api->in_flight.fetch_sub(1, std::memory_order_release);
+      api = current;
+    }
+    return nullptr;
+  }
+
+  void Release() {
+    if (api_) {
+      api_->in_flight.fetch_sub(1, std::memory_order_release);
+      api_ = nullptr;
+    }
+  }
+
+  const DxCoreApi* api_;
+};
 
 // Helper: get directory of current executable
 static std::string GetExeDir() {
@@ -67,49 +143,237 @@ static std::string GetExeDir() {
   return path.substr(0, pos + 1);
 }
 
+// Where the last successful LoadCoreDll found the library, next to the log in
+// $XDG_STATE_HOME/defyx. Stored as "path\nsize\nmtime_ns" so a replaced file
+// is not trusted blindly.
+static std::string CorePathRecordFile() {
+  std::string log = defyx_log::LogFilePath();
+  size_t pos = log.find_last_of('/');
+  return pos == std::string::npos ? "" : log.substr(0, pos + 1) + "core_path";
+}
+
+static std::string StatSignature(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return "";
+  long long mtime_ns = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+  return std::to_string(static_cast<long long>(st.st_size)) + "\n" + std::to_string(mtime_ns);
+}
+
+// Returns the remembered path if the file there is unchanged and no probe
+// location that ranks above it has a library now; otherwise "".
+static std::string RememberedCorePath(const std::vector<std::string>& probes) {
+  std::string record = CorePathRecordFile();
+  if (record.empty()) return "";
+  std::ifstream in(record);
+  std::string path, size, mtime;
+  if (!std::getline(in, path) || !std::getline(in, size) || !std::getline(in, mtime)) return "";
+  if (path.empty() || StatSignature(path) != size + "\n" + mtime) return "";
+  for (const auto& probe : probes) {
+    if (probe == path) break;
+    if (!StatSignature(probe).empty()) return "";
+  }
+  return path;
+}
+
+static void RememberCorePath(void* dll) {
+  struct link_map* map = nullptr;
+  if (dlinfo(dll, RTLD_DI_LINKMAP, &map) != 0 || !map || !map->l_name || map->l_name[0] != '/') return;
+  std::string path = map->l_name;
+  std::string signature = StatSignature(path);
+  std::string record = CorePathRecordFile();
+  if (signature.empty() || record.empty()) return;
+  std::string tmp = record + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << path << "\n" << signature << "\n";
+    if (!out) return;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, record, ec);
+}
+
 // Logger implementation
 namespace defyx_core {
 void LogMessage(const std::string& msg) {
-  // Prefix with timestamp (ms since epoch)
-  using namespace std::chrono;
-  auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-  std::lock_guard<std::mutex> lock(g_log_mutex);
-  std::string exeDir = GetExeDir();
-  std::string logPath = exeDir.empty() ? "defyx_linux.log" : (exeDir + "defyx_linux.log");
-  std::ofstream ofs;
-  ofs.open(logPath, std::ios::app);
-  if (ofs.is_open()) {
-    ofs << now << " | " << msg << "\n";
-    ofs.close();
-  }
+  defyx_log::Write(defyx_log::Level::kInfo, msg);
 }
 } // namespace defyx_core
 
-static std::function<void(std::string)> g_progress_handler;
+using ProgressHandler = std::function<void(std::string)>;
+// Swapped with std::atomic_store while DxProgressC may be running on a core
+// thread; each call works on its own snapshot, so replacing or clearing the
+// handler never destroys one mid-call.
+static std::shared_ptr<const ProgressHandler> g_progress_handler;
+// Last directory passed to SetCacheDir.
+static std::mutex g_cache_dir_mutex;
+static std::string g_cache_dir;
+// Last method passed to SetConnectionMethod, for a reloaded library.
+static std::mutex g_connection_method_mutex;
+static std::string g_connection_method;
+// Last value passed to EnableVerboseLogs, or -1 if it was never called. Kept so
+// a reloaded library starts with the same verbosity.
+static std::atomic<int> g_verbose_state{-1};
 
 static void DxProgressC(char* msg) {
   if (!msg) return;
   std::string s(msg);
-  defyx_core::LogMessage("[DX] " + s);
-  if (g_progress_handler) g_progress_handler(s);
+  defyx_log::Info("[DX] ", s);
+  connect_trace::Instant("progress", "core", s);
+  std::shared_ptr<const ProgressHandler> handler = std::atomic_load(&g_progress_handler);
+  if (handler && *handler) (*handler)(std::move(s));
+}
+
+// GNU build-id of |dll| in hex, or its path, size and mtime when it was
+// linked without one. Changes whenever the core is rebuilt.
+static std::string LibraryVersion(void* dll, const std::string& path) {
+  struct link_map* map = nullptr;
+  if (dlinfo(dll, RTLD_DI_LINKMAP, &map) == 0 && map) {
+    struct Query {
+      ElfW(Addr) base;
+      std::string id;
+    } query{map->l_addr, {}};
+    dl_iterate_phdr([](struct dl_phdr_info* info, size_t, void* data) -> int {
+      auto* query = static_cast<Query*>(data);
+      if (info->dlpi_addr != query->base) return 0;
+      for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+        if (phdr.p_type != PT_NOTE) continue;
+        const char* p = reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+        const char* end = p + phdr.p_memsz;
+        while (p + sizeof(ElfW(Nhdr)) <= end) {
+          const auto* note = reinterpret_cast<const ElfW(Nhdr)*>(p);
+          const char* name = p + sizeof(ElfW(Nhdr));
+          const char* desc = name + ((note->n_namesz + 3) & ~3u);
+          if (desc + note->n_descsz > end) break;
+          if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0) {
+            static const char kHex[] = "0123456789abcdef";
+            for (size_t j = 0; j < note->n_descsz; ++j) {
+              unsigned char byte = static_cast<unsigned char>(desc[j]);
+              query->id += kHex[byte >> 4];
+              query->id += kHex[byte & 0xf];
+            }
+            return 1;
+          }
+          p = desc + ((note->n_descsz + 3) & ~3u);
+        }
+      }
+      return 1;
+    }, &query);
+    if (!query.id.empty()) return "build-id:" + query.id;
+  }
+  std::string signature = StatSignature(path);
+  return signature.empty() ? "" : "file:" + path + "\n" + signature;
+}
+
+// Resolves every export into a fresh table. Missing exports are logged and
+// left null; the wrappers fall back to their defaults for those. Their names
+// are appended to |missing| when it is given.
+static DxCoreApi* ResolveApi(void* dll, const std::string& path,
+                             std::vector<std::string>* missing = nullptr) {
+  auto* api = new DxCoreApi();
+  api->handle = dll;
+  api->path = path;
+  api->version = LibraryVersion(dll, path);
+
+  auto resolve = [dll, missing](const char* name, auto* slot) {
+    *slot = reinterpret_cast<std::remove_pointer_t<decltype(slot)>>(dlsym(dll, name));
+    if (!*slot) {
+      defyx_log::Warn("Missing export: ", name, " (dlerror=", dlerror(), ")");
+      if (missing) missing->emplace_back(name);
+    }
+  };
+  resolve("SetProgressCallback", &api->set_progress_cb);
+  resolve("SetVerboseLogging", &api->set_verbose);
+  resolve("FreeString", &api->free_string);
+  resolve("StartVPN", &api->start_vpn);
+  resolve("StopVPN", &api->stop_vpn);
+  resolve("StartTun2Socks", &api->start_t2s);
+  resolve("StopTun2Socks", &api->stop_t2s);
+  resolve("Stop", &api->stop_all);
+  resolve("MeasurePing", &api->measure_ping);
+  resolve("GetFlag", &api->get_flag);
+  resolve("SetAsnName", &api->set_asn_name);
+  resolve("SetTimeZone", &api->set_timezone);
+  resolve("GetFlowLine", &api->get_flowline);
+  resolve("GetCachedFlowLine", &api->get_cached_flowline);
+  resolve("DecodeAndVerifyFlowline", &api->decode_verify_flowline);
+  resolve("GetVpnStatus", &api->get_vpn_status);
+  resolve("SetConnectionMethod", &api->set_connection_method);
+  resolve("SetCacheDir", &api->set_cache_dir);
+  resolve("IsTunnelRunning", &api->is_tunnel_running);
+  return api;
+}
+
+// Hands the progress callback, verbosity, cache dir and connection method
+// already requested by the app to a freshly resolved table, before it is
+// published.
+static void ApplyRegisteredCallbacks(const DxCoreApi* api) {
+  if (std::atomic_load(&g_progress_handler) && api->set_progress_cb) {
+    api->set_progress_cb(&DxProgressC);
+  }
+  int verbose = g_verbose_state.load(std::memory_order_relaxed);
+  if (verbose >= 0 && api->set_verbose) {
+    api->set_verbose(verbose);
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_cache_dir_mutex);
+    if (!g_cache_dir.empty() && api->set_cache_dir) {
+      api->set_cache_dir(g_cache_dir.c_str());
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_connection_method_mutex);
+    if (!g_connection_method.empty() && api->set_connection_method) {
+      api->set_connection_method(g_connection_method.c_str());
+    }
+  }
+}
+
+// Parks an unpublished table. Its library is never closed (see
+// g_retired_apis); calls still running through it finish normally. Must be
+// called with g_dx_mutex held.
+static void RetireApi(const DxCoreApi* api) {
+  int in_flight = api->in_flight.load(std::memory_order_acquire);
+  if (in_flight > 0) {
+    defyx_log::Info("Retiring libDXcore.so table with ", in_flight, " calls still in flight");
+  }
+  g_retired_apis.emplace_back(const_cast<DxCoreApi*>(api));
 }
 
 bool LoadCoreDll(const std::string& dllPath) {
   std::lock_guard<std::mutex> lock(g_dx_mutex);
-  if (g_dx_dll) return true;
+  if (g_api.load(std::memory_order_acquire)) return true;
 
   std::string path = dllPath;
   void* dll = nullptr;
-
-  // 1) Prefer loading from the exe directory
   std::string exeDir = GetExeDir();
+
+  // 0) Go straight to where the last launch found it, skipping the failed
+  // probes below, as long as nothing ranks above it now.
+  std::vector<std::string> probes;
   if (!exeDir.empty()) {
+    probes.push_back(exeDir + "libDXcore.so");
+    probes.push_back(exeDir + "lib/libDXcore.so");
+  }
+  if (!dllPath.empty()) probes.push_back(dllPath);
+  std::string remembered = RememberedCorePath(probes);
+  if (!remembered.empty()) {
+    dll = dlopen(remembered.c_str(), RTLD_LAZY);
+    if (dll) {
+      defyx_log::Info("Loaded libDXcore.so from remembered path: ", remembered);
+      path = remembered;
+    }
+  }
+
+  // 1) Prefer loading from the exe directory
+  if (!dll && !exeDir.empty()) {
     std::string full = exeDir + "libDXcore.so";
     dll = dlopen(full.c_str(), RTLD_LAZY);
     if (!dll) {
-      defyx_core::LogMessage("dlopen failed for exe-dir path '" + full + "' err=" + std::string(dlerror()));
+      defyx_log::Debug("dlopen failed for exe-dir path '", full, "' err=", dlerror());
     } else {
-      defyx_core::LogMessage("Loaded libDXcore.so from exe dir: " + full);
+      defyx_log::Info("Loaded libDXcore.so from exe dir: ", full);
+      path = full;
     }
   }
 
@@ -118,9 +382,10 @@ bool LoadCoreDll(const std::string& dllPath) {
     std::string nested = exeDir + "lib/libDXcore.so";
     dll = dlopen(nested.c_str(), RTLD_LAZY);
     if (!dll) {
-      defyx_core::LogMessage("dlopen failed for lib-dir path '" + nested + "' err=" + std::string(dlerror()));
+      defyx_log::Debug("dlopen failed for lib-dir path '", nested, "' err=", dlerror());
     } else {
-      defyx_core::LogMessage("Loaded libDXcore.so from lib dir: " + nested);
+      defyx_log::Info("Loaded libDXcore.so from lib dir: ", nested);
+      path = nested;
     }
   }
 
@@ -128,9 +393,9 @@ bool LoadCoreDll(const std::string& dllPath) {
   if (!dll && !path.empty()) {
     dll = dlopen(path.c_str(), RTLD_LAZY);
     if (!dll) {
-      defyx_core::LogMessage("dlopen failed for provided path '" + path + "' err=" + std::string(dlerror()));
+      defyx_log::Warn("dlopen failed for provided path '", path, "' err=", dlerror());
     } else {
-      defyx_core::LogMessage("Loaded libDXcore.so from provided path: " + path);
+      defyx_log::Info("Loaded libDXcore.so from provided path: ", path);
     }
   }
 
@@ -138,92 +403,129 @@ bool LoadCoreDll(const std::string& dllPath) {
   if (!dll) {
     dll = dlopen("libDXcore.so", RTLD_LAZY);
     if (!dll) {
-      defyx_core::LogMessage("Final dlopen('libDXcore.so') failed err=" + std::string(dlerror()));
+      defyx_log::Error("Final dlopen('libDXcore.so') failed err=", dlerror());
       return false;
     } else {
-      defyx_core::LogMessage("Loaded libDXcore.so from default search path");
+      defyx_log::Info("Loaded libDXcore.so from default search path");
+      path = "libDXcore.so";
     }
   }
 
-  g_dx_dll = dll;
-
-  g_start_vpn = (dx_start_vpn_fn)dlsym(g_dx_dll, "StartVPN");
-  g_stop_vpn = (dx_stop_vpn_fn)dlsym(g_dx_dll, "StopVPN");
-  g_start_t2s = (dx_start_t2s_fn)dlsym(g_dx_dll, "StartTun2Socks");
-  g_stop_t2s = (dx_stop_t2s_fn)dlsym(g_dx_dll, "StopTun2Socks");
-  g_stop_all = (dx_stop_fn)dlsym(g_dx_dll, "Stop");
-  g_measure_ping = (dx_measure_ping_fn)dlsym(g_dx_dll, "MeasurePing");
-  g_get_flag = (dx_get_flag_fn)dlsym(g_dx_dll, "GetFlag");
-  g_set_asn_name = (dx_set_asn_name_fn)dlsym(g_dx_dll, "SetAsnName");
-  g_set_timezone = (dx_set_timezone_fn)dlsym(g_dx_dll, "SetTimeZone");
-  g_get_flowline = (dx_get_flowline_fn)dlsym(g_dx_dll, "GetFlowLine");
-  g_get_cached_flowline = (dx_get_cached_flowline_fn)dlsym(g_dx_dll, "GetCachedFlowLine");
-  g_decode_verify_flowline = (dx_decode_verify_flowline_fn)dlsym(g_dx_dll, "DecodeAndVerifyFlowline");
-  g_get_vpn_status = (dx_get_vpn_status_fn)dlsym(g_dx_dll, "GetVpnStatus");
-  g_set_progress_cb = (dx_set_progress_callback_fn)dlsym(g_dx_dll, "SetProgressCallback");
-  g_set_verbose = (dx_set_verbose_logging_fn)dlsym(g_dx_dll, "SetVerboseLogging");
-  g_free_string = (dx_free_string_fn)dlsym(g_dx_dll, "FreeString");
-  g_set_connection_method = (dx_set_connection_method_fn)dlsym(g_dx_dll, "SetConnectionMethod");
-  g_set_cache_dir = (dx_set_cache_dir_fn)dlsym(g_dx_dll, "SetCacheDir");
-  g_is_tunnel_running = (dx_is_tunnel_running_fn)dlsym(g_dx_dll, "IsTunnelRunning");
-
-  auto check = [](const char* name, auto fn) {
-    if (!fn) {
-      defyx_core::LogMessage(std::string("Missing export: ") + name + " (dlerror=" + std::string(dlerror()) + ")");
-    }
-  };
-  check("SetProgressCallback", g_set_progress_cb);
-  check("SetVerboseLogging", g_set_verbose);
-  check("FreeString", g_free_string);
-  check("StartVPN", g_start_vpn);
-  check("StopVPN", g_stop_vpn);
-  check("StartTun2Socks", g_start_t2s);
-  check("StopTun2Socks", g_stop_t2s);
-  check("Stop", g_stop_all);
-  check("MeasurePing", g_measure_ping);
-  check("GetFlag", g_get_flag);
-  check("SetAsnName", g_set_asn_name);
-  check("SetTimeZone", g_set_timezone);
-  check("GetFlowLine", g_get_flowline);
-  check("GetCachedFlowLine", g_get_cached_flowline);
-  check("DecodeAndVerifyFlowline", g_decode_verify_flowline);
-  check("GetVpnStatus", g_get_vpn_status);
-  check("SetConnectionMethod", g_set_connection_method);
-  check("SetCacheDir", g_set_cache_dir);
-  check("IsTunnelRunning", g_is_tunnel_running);
-  defyx_core::LogMessage("libDXcore.so loaded and symbol lookup completed");
+  const DxCoreApi* api = ResolveApi(dll, path);
+  ApplyRegisteredCallbacks(api);
+  g_api.store(api, std::memory_order_release);
+  defyx_log::Info("libDXcore.so loaded and symbol lookup completed");
+  // ReloadCoreDll deliberately doesn't do this: a library swapped in for
+  // testing shouldn't become the default for the next launch.
+  if (path != remembered) RememberCorePath(dll);
 
   return true;
 }
 
 void UnloadCoreDll() {
   std::lock_guard<std::mutex> lock(g_dx_mutex);
-  if (g_dx_dll) {
-    defyx_core::LogMessage("Unloading libDXcore.so");
-    g_start_vpn = nullptr;
-    g_stop_vpn = nullptr;
-    g_start_t2s = nullptr;
-    g_stop_t2s = nullptr;
-    g_stop_all = nullptr;
-    g_measure_ping = nullptr;
-    g_get_flag = nullptr;
-    g_set_asn_name = nullptr;
-    g_set_timezone = nullptr;
-    g_get_flowline = nullptr;
-    g_get_cached_flowline = nullptr;
-    g_get_vpn_status = nullptr;
-    g_set_progress_cb = nullptr;
-    g_set_verbose = nullptr;
-    g_free_string = nullptr;
-  g_set_connection_method = nullptr;
-  g_is_tunnel_running = nullptr;
-
-    // Clear progress handler
-    g_progress_handler = nullptr;
-
-    dlclose(g_dx_dll);
-    g_dx_dll = nullptr;
+  const DxCoreApi* api = g_api.exchange(nullptr, std::memory_order_seq_cst);
+  if (!api) return;
+  defyx_log::Info("Unloading libDXcore.so");
+
+  // Clear progress handler; a callback already running keeps its snapshot.
+  std::atomic_store(&g_progress_handler, std::shared_ptr<const ProgressHandler>());
+
+  // New calls can no longer pick the table up. The Go runtime stays resident:
+  // the library is unpublished, not unmapped.
+  RetireApi(api);
+}
+
+bool ReloadCoreDll(const std::string& dllPath, std::string* error) {
+  auto fail = [error](const char* code) {
+    if (error) *error = code;
+    return false;
+  };
+  if (dllPath.empty()) return fail("INVALID_PATH");
+
+  std::lock_guard<std::mutex> lock(g_dx_mutex);
+  defyx_log::Info("Reloading libDXcore.so from ", dllPath);
+
+  const DxCoreApi* old_api = g_api.load(std::memory_order_acquire);
+  auto refusal = [old_api]() -> const char* {
+    if (!old_api) return nullptr;
+    // A call still running on the old table, StartVPN above all, could bring
+    // up a tunnel that nothing would be able to stop after the swap.
+    int in_flight = old_api->in_flight.load(std::memory_order_seq_cst);
+    if (in_flight > 0) {
+      defyx_log::Warn("Reload refused: ", in_flight, " calls in flight on the current core");
+      return "BUSY";
+    }
+    // Swapping under a live tunnel would strand it inside the old library.
+    if (old_api->is_tunnel_running && old_api->is_tunnel_running() != 0) {
+      defyx_log::Warn("Reload refused: tunnel is running on the current core");
+      return "TUNNEL_ACTIVE";
+    }
+    return nullptr;
+  };
+  // An early answer before dlopen, since a Go library that has been opened
+  // can't be closed again. Only the check after unpublishing below is binding.
+  if (const char* code = refusal()) return fail(code);
+
+  // RTLD_NOW so unresolved dependencies fail here rather than on first call.
+  void* dll = dlopen(dllPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!dll) {
+    defyx_log::Error("Reload dlopen('", dllPath, "') failed err=", dlerror());
+    return fail("LOAD_FAILED");
+  }
+
+  if (old_api && old_api->handle == dll) {
+    // dlopen hands back the existing mapping for a path that is already
+    // loaded, so a rebuilt library has to be shipped under a new file name.
+    // This only drops the extra reference.
+    dlclose(dll);
+    defyx_log::Warn("Reload skipped: ", dllPath, " is already the loaded core");
+    return fail("ALREADY_LOADED");
+  }
+
+  // From here on a rejected library stays mapped: its Go runtime started in
+  // dlopen and can't be unloaded.
+  std::vector<std::string> missing;
+  std::unique_ptr<DxCoreApi> api(ResolveApi(dll, dllPath, &missing));
+  if (!missing.empty()) {
+    defyx_log::Error("Reload rejected: ", missing.size(), " required exports missing from ", dllPath,
+                     "; it stays mapped");
+    return fail("MISSING_EXPORTS");
+  }
+
+  // Same protocol as UnloadCoreDll: once the old table is unpublished, a lease
+  // either was counted in in_flight before the exchange or sees null, so
+  // nothing can start on the old core between the check and the swap.
+  g_api.exchange(nullptr, std::memory_order_seq_cst);
+  if (const char* code = refusal()) {
+    g_api.store(old_api, std::memory_order_seq_cst);
+    defyx_log::Warn("Reload abandoned; ", dllPath, " stays mapped unused");
+    return fail(code);
+  }
+
+  ApplyRegisteredCallbacks(api.get());
+  g_api.store(api.release(), std::memory_order_seq_cst);
+  defyx_log::Info("Switched libDXcore.so to ", dllPath);
+
+  if (old_api) {
+    // The old Go runtime stays resident for the life of the process.
+    RetireApi(old_api);
+  }
+  return true;
+}
+
+// Leases the published table, loading the library first only if nothing is
+// published yet. The common path is a single lease acquisition.
+static ApiLease AcquireApi() {
+  ApiLease api;
+  if (!api) {
+    // Loading dlopens the Go core, or waits on g_dx_mutex for the prewarm
+    // thread that is doing so.
+    DEFYX_ASSERT_OFF_MAIN_THREAD("defyx_core: loading libDXcore.so");
+    LoadCoreDll("");
+    api = ApiLease();
   }
+  return api;
 }
 
 namespace defyx_core {
@@ -235,29 +537,86 @@ void UnloadCoreDll() {
   ::UnloadCoreDll();
 }
 
+bool ReloadCoreDll(const std::string& dllPath, std::string* error) {
+  return ::ReloadCoreDll(dllPath, error);
+}
+
 void EnableVerboseLogs(bool enable) {
-  if (g_set_verbose) {
-    g_set_verbose(enable ? 1 : 0);
+  g_verbose_state.store(enable ? 1 : 0, std::memory_order_relaxed);
+  ApiLease api;
+  if (api && api->set_verbose) {
+    api->set_verbose(enable ? 1 : 0);
   }
 }
 
 void RegisterProgressHandler(std::function<void(std::string)> handler) {
-  g_progress_handler = std::move(handler);
-  if (g_set_progress_cb) {
-    g_set_progress_cb(&DxProgressC);
+  std::atomic_store(&g_progress_handler, std::make_shared<const ProgressHandler>(std::move(handler)));
+  ApiLease api;
+  if (api && api->set_progress_cb) {
+    api->set_progress_cb(&DxProgressC);
   }
 }
 } // namespace defyx_core
 
 namespace defyx_core {
 
+CoreString::CoreString(CoreString&& other) noexcept
+    : api_(other.api_),
+      core_(other.core_),
+      size_(other.size_),
+      owned_(std::move(other.owned_)),
+      shared_(std::move(other.shared_)) {
+  other.api_ = nullptr;
+  other.core_ = nullptr;
+  other.size_ = 0;
+}
+
+CoreString& CoreString::operator=(CoreString&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    api_ = other.api_;
+    core_ = other.core_;
+    size_ = other.size_;
+    owned_ = std::move(other.owned_);
+    shared_ = std::move(other.shared_);
+    other.api_ = nullptr;
+    other.core_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+void CoreString::Reset() {
+  if (api_) {
+    if (core_ && api_->free_string) api_->free_string(core_);
+    api_->in_flight.fetch_sub(1, std::memory_order_release);
+  }
+  api_ = nullptr;
+  core_ = nullptr;
+  size_ = 0;
+}
+
+// Takes ownership of |value| as returned by |api|; the caller must hold a lease
+// on |api|. The string pins the table itself until it is released.
+CoreString AdoptCoreString(const DxCoreApi* api, char* value) {
+  CoreString result;
+  if (!value) return result;
+  api->in_flight.fetch_add(1, std::memory_order_relaxed);
+  result.api_ = api;
+  result.core_ = value;
+  result.size_ = std::strlen(value);
+  return result;
+}
+
 bool StartVPN(const std::string& cacheDir, const std::string& flowLine, const std::string& pattern) {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("StartVPN");
   try {
-    defyx_core::LogMessage("StartVPN called cacheDir='" + cacheDir + "' flowLine='" + flowLine + "' pattern='" + pattern + "'");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_start_vpn) {
-      int r = g_start_vpn(cacheDir.c_str(), flowLine.c_str(), pattern.c_str());
-      defyx_core::LogMessage(std::string("StartVPN returned ") + (r != 0 ? "true" : "false"));
+    defyx_log::Info("StartVPN called cacheDir='", cacheDir, "' flowLine=", defyx_log::Payload{flowLine},
+                    " pattern='", pattern, "'");
+    auto api = AcquireApi();
+    if (api && api->start_vpn) {
+      int r = api->start_vpn(cacheDir.c_str(), flowLine.c_str(), pattern.c_str());
+      defyx_log::Info("StartVPN returned ", r != 0);
       return r != 0;
     }
   } catch (...) {}
@@ -267,10 +626,10 @@ bool StartVPN(const std::string& cacheDir, const std::string& flowLine, const st
 
 void StartTun2Socks(long long fd, const std::string& addr) {
   try {
-    defyx_core::LogMessage("StartTun2Socks called fd=" + std::to_string(fd) + " addr='" + addr + "'");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_start_t2s) {
-      g_start_t2s(fd, addr.c_str());
+    defyx_log::Info("StartTun2Socks called fd=", fd, " addr='", addr, "'");
+    auto api = AcquireApi();
+    if (api && api->start_t2s) {
+      api->start_t2s(fd, addr.c_str());
       return;
     }
   } catch (...) {}
@@ -278,12 +637,13 @@ void StartTun2Socks(long long fd, const std::string& addr) {
 }
 
 long long MeasurePing() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("MeasurePing");
   try {
-    defyx_core::LogMessage("MeasurePing called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_measure_ping) {
-      auto v = g_measure_ping();
-      defyx_core::LogMessage("MeasurePing returned " + std::to_string(v));
+    defyx_log::Trace("MeasurePing called");
+    auto api = AcquireApi();
+    if (api && api->measure_ping) {
+      auto v = api->measure_ping();
+      defyx_log::Debug("MeasurePing returned ", v);
       return v;
     }
   } catch (...) {}
@@ -293,12 +653,13 @@ long long MeasurePing() {
 }
 
 bool StopVPN() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("StopVPN");
   try {
-    defyx_core::LogMessage("StopVPN called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_stop_vpn) {
-      auto r = g_stop_vpn() != 0;
-      defyx_core::LogMessage(std::string("StopVPN returned ") + (r ? "true" : "false"));
+    defyx_log::Info("StopVPN called");
+    auto api = AcquireApi();
+    if (api && api->stop_vpn) {
+      auto r = api->stop_vpn() != 0;
+      defyx_log::Info("StopVPN returned ", r);
       return r;
     }
   } catch (...) {}
@@ -307,144 +668,149 @@ bool StopVPN() {
 
 void StopTun2Socks() {
   try {
-    defyx_core::LogMessage("StopTun2Socks called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_stop_t2s) { g_stop_t2s(); return; }
+    defyx_log::Info("StopTun2Socks called");
+    auto api = AcquireApi();
+    if (api && api->stop_t2s) { api->stop_t2s(); return; }
   } catch (...) {}
 }
 
 void Stop() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("Stop");
   try {
-    defyx_core::LogMessage("Stop called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_stop_all) { g_stop_all(); return; }
+    defyx_log::Info("Stop called");
+    auto api = AcquireApi();
+    if (api && api->stop_all) { api->stop_all(); return; }
   } catch (...) {}
 }
 
-std::string GetFlag() {
+CoreString GetFlag() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("GetFlag");
   try {
-    defyx_core::LogMessage("GetFlag called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_get_flag) {
-      char* flag = g_get_flag();
-      std::string result = flag ? std::string(flag) : std::string();
-      if (g_free_string && flag) g_free_string(flag);
-      return result;
+    defyx_log::Trace("GetFlag called");
+    auto api = AcquireApi();
+    if (api && api->get_flag) {
+      return AdoptCoreString(api.get(), api->get_flag());
     }
   } catch (...) {}
-  return "xx";
+  return CoreString("xx");
 }
 
-void SetAsnName() {
+bool SetAsnName() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("SetAsnName");
   try {
-    defyx_core::LogMessage("SetAsnName called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_set_asn_name) { g_set_asn_name(); return; }
+    defyx_log::Debug("SetAsnName called");
+    auto api = AcquireApi();
+    if (api && api->set_asn_name) { api->set_asn_name(); return true; }
   } catch (...) {}
+  return false;
 }
 
 void SetTimeZone(float tz) {
   try {
-    defyx_core::LogMessage("SetTimeZone called tz=" + std::to_string(tz));
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_set_timezone) { g_set_timezone(tz); return; }
+    defyx_log::Debug("SetTimeZone called tz=", tz);
+    auto api = AcquireApi();
+    if (api && api->set_timezone) { api->set_timezone(tz); return; }
   } catch (...) {}
   (void)tz;
 }
 
-std::string GetFlowLine(bool isTest) {
+CoreString GetFlowLine(bool isTest) {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("GetFlowLine");
   try {
-    defyx_core::LogMessage("GetFlowLine called isTest=" + std::to_string(isTest));
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_get_flowline) {
-      char* line = g_get_flowline(isTest ? 1 : 0);
-      std::string result = line ? std::string(line) : std::string();
-      if (g_free_string && line) g_free_string(line);
-      return result;
+    defyx_log::Debug("GetFlowLine called isTest=", isTest);
+    auto api = AcquireApi();
+    if (api && api->get_flowline) {
+      return AdoptCoreString(api.get(), api->get_flowline(isTest ? 1 : 0));
     }
   } catch (...) {}
-  return "default";
+  return CoreString("default");
 }
 
-std::string GetCachedFlowLine() {
+CoreString GetCachedFlowLine() {
   try {
-    defyx_core::LogMessage("GetCachedFlowLine called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_get_cached_flowline) {
-      char* line = g_get_cached_flowline();
-      std::string result = line ? std::string(line) : std::string();
-      if (g_free_string && line) g_free_string(line);
-      return result;
+    defyx_log::Debug("GetCachedFlowLine called");
+    auto api = AcquireApi();
+    if (api && api->get_cached_flowline) {
+      return AdoptCoreString(api.get(), api->get_cached_flowline());
     }
   } catch (...) {}
-  return "";
+  return CoreString();
 }
 
-std::string DecodeAndVerifyFlowline(const std::string& flowLine) {
+CoreString DecodeAndVerifyFlowline(const std::string& flowLine) {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("DecodeAndVerifyFlowline");
   try {
-    defyx_core::LogMessage("DecodeAndVerifyFlowline called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_decode_verify_flowline) {
-      char* decoded = g_decode_verify_flowline(flowLine.c_str());
-      std::string result = decoded ? std::string(decoded) : std::string();
-      if (g_free_string && decoded) g_free_string(decoded);
-      return result;
+    defyx_log::Debug("DecodeAndVerifyFlowline called input=", defyx_log::Payload{flowLine});
+    auto api = AcquireApi();
+    if (api && api->decode_verify_flowline) {
+      return AdoptCoreString(api.get(), api->decode_verify_flowline(flowLine.c_str()));
     }
   } catch (...) {}
-  return "";
+  return CoreString();
 }
 
-std::string GetVpnStatus() {
+std::string CoreVersion() {
+  auto api = AcquireApi();
+  return api ? api->version : std::string();
+}
+
+CoreString GetVpnStatus() {
   try {
-    defyx_core::LogMessage("GetVpnStatus called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_get_vpn_status) {
-      char* status = g_get_vpn_status();
-      std::string result = status ? std::string(status) : std::string();
-      if (g_free_string && status) g_free_string(status);
-      return result;
+    defyx_log::Trace("GetVpnStatus called");
+    auto api = AcquireApi();
+    if (api && api->get_vpn_status) {
+      return AdoptCoreString(api.get(), api->get_vpn_status());
     }
   } catch (...) {}
-  return "disconnected";
+  return CoreString("disconnected");
 }
 
 void SetConnectionMethod(const std::string& method) {
   try {
-    defyx_core::LogMessage("SetConnectionMethod called method=" + method);
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_set_connection_method) {
-      g_set_connection_method(method.c_str());
+    defyx_log::Info("SetConnectionMethod called method=", method);
+    {
+      std::lock_guard<std::mutex> lock(g_connection_method_mutex);
+      g_connection_method = method;
+    }
+    auto api = AcquireApi();
+    if (api && api->set_connection_method) {
+      api->set_connection_method(method.c_str());
     }
   } catch (...) {}
 }
 
+std::string CacheDir() {
+  std::lock_guard<std::mutex> lock(g_cache_dir_mutex);
+  return g_cache_dir;
+}
+
 void SetCacheDir(const std::string& cacheDir) {
   try {
-    defyx_core::LogMessage("SetCacheDir called cacheDir=" + cacheDir);
+    defyx_log::Info("SetCacheDir called cacheDir=", cacheDir);
     
-    // Create directory if it doesn't exist
-    std::error_code ec;
-    std::filesystem::create_directories(cacheDir, ec);
-    if (ec) {
-      defyx_core::LogMessage("Failed to create cache directory: " + ec.message());
-    } else {
-      defyx_core::LogMessage("Created cache directory");
-    }
+    // Create directory if it doesn't exist; private, since the core keeps
+    // flowlines there.
+    cache_manager::EnsurePrivateDir(cacheDir);
     
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_set_cache_dir) {
-      g_set_cache_dir(cacheDir.c_str());
+    {
+      std::lock_guard<std::mutex> lock(g_cache_dir_mutex);
+      g_cache_dir = cacheDir;
+    }
+
+    auto api = AcquireApi();
+    if (api && api->set_cache_dir) {
+      api->set_cache_dir(cacheDir.c_str());
     }
   } catch (...) {}
 }
 
 bool IsTunnelRunning() {
   try {
-    defyx_core::LogMessage("IsTunnelRunning called");
-    if (!g_dx_dll) LoadCoreDll("");
-    if (g_is_tunnel_running) {
-      bool running = g_is_tunnel_running() != 0;
-      defyx_core::LogMessage(std::string("IsTunnelRunning returned ") + (running ? "true" : "false"));
+    defyx_log::Trace("IsTunnelRunning called");
+    auto api = AcquireApi();
+    if (api && api->is_tunnel_running) {
+      bool running = api->is_tunnel_running() != 0;
+      defyx_log::Trace("IsTunnelRunning returned ", running);
       return running;
     }
   } catch (...) {}
@@ -1,11 +1,63 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <functional>
 
+struct DxCoreApi;
+
 namespace defyx_core {
-// Simple logger to help with debugging native code. Writes to a log file next
-// to the executable.
+
+// A string returned by libDXcore.so. Holds the core's own allocation and
+// releases it with FreeString on destruction, so reading it never copies.
+// While alive it also keeps the library from being unloaded, so don't hold
+// on to one longer than a call. Fallback values that never came from the core
+// are stored inline, and cached results share the cache's copy.
+class CoreString {
+ public:
+  CoreString() = default;
+  explicit CoreString(std::string value) : owned_(std::move(value)) {}
+  explicit CoreString(std::shared_ptr<const std::string> shared) : shared_(std::move(shared)) {}
+  ~CoreString() { Reset(); }
+
+  CoreString(CoreString&& other) noexcept;
+  CoreString& operator=(CoreString&& other) noexcept;
+  CoreString(const CoreString&) = delete;
+  CoreString& operator=(const CoreString&) = delete;
+
+  std::string_view view() const {
+    if (core_) return std::string_view(core_, size_);
+    return shared_ ? std::string_view(*shared_) : std::string_view(owned_);
+  }
+  // Always NUL-terminated.
+  const char* data() const {
+    if (core_) return core_;
+    return shared_ ? shared_->c_str() : owned_.c_str();
+  }
+  size_t size() const { return view().size(); }
+  bool empty() const { return size() == 0; }
+  std::string str() const { return std::string(view()); }
+  // False for fallback values produced when the core export is unavailable.
+  bool from_core() const { return core_ != nullptr || shared_ != nullptr; }
+
+ private:
+  friend CoreString AdoptCoreString(const ::DxCoreApi* api, char* value);
+
+  void Reset();
+
+  const ::DxCoreApi* api_ = nullptr;
+  char* core_ = nullptr;
+  size_t size_ = 0;
+  std::string owned_;
+  std::shared_ptr<const std::string> shared_;
+};
+
+// Simple logger to help with debugging native code. Writes to the rotated log
+// under $XDG_STATE_HOME/defyx (see defyx_logger.h); the write is queued and
+// flushed by a background thread, so this never blocks the caller.
 void LogMessage(const std::string& msg);
 
 bool StartVPN(const std::string& cacheDir, const std::string& flowLine, const std::string& pattern);
@@ -14,15 +66,21 @@ void StartTun2Socks(long long fd, const std::string& addr);
 void StopTun2Socks();
 void Stop();
 long long MeasurePing();
-std::string GetFlag();
-void SetAsnName();
+CoreString GetFlag();
+// Returns false if the core export was not available.
+bool SetAsnName();
 void SetTimeZone(float tz);
-std::string GetFlowLine(bool isTest = false);
-std::string GetCachedFlowLine();
-std::string DecodeAndVerifyFlowline(const std::string& flowLine);
-std::string GetVpnStatus();
+CoreString GetFlowLine(bool isTest = false);
+CoreString GetCachedFlowLine();
+CoreString DecodeAndVerifyFlowline(const std::string& flowLine);
+CoreString GetVpnStatus();
 void SetConnectionMethod(const std::string& method);
 void SetCacheDir(const std::string& cacheDir);
+// Last directory given to SetCacheDir, or "" if it was never called.
+std::string CacheDir();
+// Identifies the build of the loaded core (GNU build-id, or path, size and
+// mtime). Loads the library if needed; "" if that fails.
+std::string CoreVersion();
 bool IsTunnelRunning();
 
 // Shared library callback and logging setup
@@ -33,5 +91,17 @@ void RegisterProgressHandler(std::function<void(std::string)> handler);
 // to locate libDXcore.so next to the running executable or in application folder.
 // Returns true if the shared library was loaded and entrypoints found.
 bool LoadCoreDll(const std::string& dllPath = "");
+// Unpublishes the loaded library. Calls made afterwards fall back to defaults
+// until the library is loaded again. The library itself stays mapped: Go
+// c-shared libraries can't be unloaded.
 void UnloadCoreDll();
+
+// Loads the library at |dllPath| alongside the current one, checks that every
+// export is present, re-registers the progress callback, verbosity, cache dir
+// and connection method, and switches calls over to it. Refused while a tunnel
+// is running or any call is still in flight on the current library. The old
+// library, and its Go runtime, stay resident. On failure the current library
+// stays in use and |error| (if given) receives a short code: INVALID_PATH,
+// LOAD_FAILED, ALREADY_LOADED, MISSING_EXPORTS, BUSY or TUNNEL_ACTIVE.
+bool ReloadCoreDll(const std::string& dllPath, std::string* error = nullptr);
 } // namespace defyx_core
\ No newline at end of file
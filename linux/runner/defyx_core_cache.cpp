@@ -0,0 +1,258 @@
+#include "defyx_core_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "defyx_logger.h"
+#include "single_flight.h"
+
+namespace defyx_core {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Set by the channel handler to post onto its executor's background lane.
+std::mutex g_refresh_post_mutex;
+std::function<bool(std::function<void()>)> g_refresh_post;
+
+bool PostRefresh(std::function<void()> task) {
+  std::lock_guard<std::mutex> lock(g_refresh_post_mutex);
+  return g_refresh_post && g_refresh_post(std::move(task));
+}
+
+// What one core fetch produced, shareable between coalesced callers.
+struct FetchResult {
+  std::shared_ptr<const std::string> value;
+  bool from_core = false;
+  // Cache generation when the core call started.
+  uint64_t generation = 0;
+};
+
+// One cached core call. Misses that overlap share a single core call.
+// Instances live for the whole process.
+class CachedCall {
+ public:
+  CachedCall(const char* name, Clock::duration ttl, Clock::duration max_stale,
+             std::function<CoreString()> fetch)
+      : name_(name), ttl_(ttl), max_stale_(max_stale), fetch_(std::move(fetch)) {}
+
+  CoreString Get() {
+    uint64_t generation;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (value_) {
+        auto age = Clock::now() - fetched_at_;
+        if (age < ttl_) {
+          hits_.fetch_add(1, std::memory_order_relaxed);
+          return CoreString(value_);
+        }
+        if (age < max_stale_) {
+          stale_hits_.fetch_add(1, std::memory_order_relaxed);
+          CoreString stale(value_);
+          if (!refreshing_) {
+            refreshing_ = true;
+            generation = generation_;
+            lock.unlock();
+            if (!PostRefresh([this, generation] { Refresh(generation); })) {
+              // No executor, or its lane is full: a later call tries again.
+              lock.lock();
+              if (generation == generation_) refreshing_ = false;
+            }
+          }
+          return stale;
+        }
+      }
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      generation = generation_;
+    }
+
+    // The flight may be a refresh, or a miss, that started before the last
+    // Invalidate() and so answers for the old route; wait for one that began
+    // after it.
+    FetchResult result;
+    do {
+      result = flight_.Do([this] {
+        FetchResult fetched = Fetch();
+        if (fetched.from_core) Store(fetched.generation, fetched.value);
+        return fetched;
+      });
+    } while (result.generation < generation);
+    return CoreString(std::move(result.value));
+  }
+
+  void Invalidate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+    value_.reset();
+    refreshing_ = false;
+  }
+
+  ResultCacheStats Stats() const {
+    ResultCacheStats stats;
+    stats.name = name_;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.stale_hits = stale_hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.refreshes = refreshes_.load(std::memory_order_relaxed);
+    stats.joined = flight_.joined();
+    return stats;
+  }
+
+ private:
+  FetchResult Fetch() {
+    FetchResult fetched;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fetched.generation = generation_;
+    }
+    CoreString result = fetch_();
+    fetched.from_core = result.from_core();
+    fetched.value = std::make_shared<const std::string>(result.view());
+    return fetched;
+  }
+
+  void Refresh(uint64_t generation) {
+    FetchResult result = flight_.Do([this] { return Fetch(); });
+    if (result.from_core) {
+      Store(result.generation, std::move(result.value));
+      refreshes_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      defyx_log::Debug("Result cache refresh of ", name_, " fell back; keeping stale value");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation == generation_) refreshing_ = false;
+  }
+
+  // Results fetched before an invalidation describe the old connection and
+  // are discarded.
+  void Store(uint64_t generation, std::shared_ptr<const std::string> value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) return;
+    value_ = std::move(value);
+    fetched_at_ = Clock::now();
+  }
+
+  const char* const name_;
+  const Clock::duration ttl_;
+  const Clock::duration max_stale_;
+  const std::function<CoreString()> fetch_;
+  SingleFlight<FetchResult> flight_;
+
+  std::mutex mutex_;
+  std::shared_ptr<const std::string> value_;
+  Clock::time_point fetched_at_;
+  uint64_t generation_ = 0;
+  bool refreshing_ = false;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> stale_hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> refreshes_{0};
+};
+
+using std::chrono::minutes;
+using std::chrono::seconds;
+
+// Leaked on purpose: a refresh may still be queued or running at exit.
+CachedCall& FlagCache() {
+  static auto* cache = new CachedCall("getFlag", seconds(30), minutes(5), [] { return GetFlag(); });
+  return *cache;
+}
+
+CachedCall& FlowLineCache(bool isTest) {
+  static auto* live = new CachedCall("getFlowLine", minutes(2), minutes(30),
+                                     [] { return GetFlowLine(false); });
+  static auto* test = new CachedCall("getFlowLine(test)", minutes(2), minutes(30),
+                                     [] { return GetFlowLine(true); });
+  return isTest ? *test : *live;
+}
+
+CachedCall& CachedFlowLineCache() {
+  static auto* cache = new CachedCall("getCachedFlowLine", minutes(2), minutes(30),
+                                      [] { return GetCachedFlowLine(); });
+  return *cache;
+}
+
+// SetAsnName has no result; the cached value only records that it ran.
+CachedCall& AsnCache() {
+  static auto* cache = new CachedCall("setAsnName", minutes(10), minutes(60), [] {
+    return SetAsnName() ? CoreString(std::make_shared<const std::string>()) : CoreString();
+  });
+  return *cache;
+}
+
+// MeasurePing is never cached, only coalesced: overlapping probes would
+// compete for the same link and skew each other.
+constexpr auto kDefaultPingMinInterval = std::chrono::milliseconds(1500);
+
+SingleFlight<long long>& PingFlight() {
+  static auto* flight = [] {
+    auto interval = std::chrono::milliseconds(kDefaultPingMinInterval);
+    if (const char* env = std::getenv("DEFYX_PING_MIN_INTERVAL_MS")) {
+      interval = std::chrono::milliseconds(std::max(0L, std::strtol(env, nullptr, 10)));
+    }
+    return new SingleFlight<long long>(interval);
+  }();
+  return *flight;
+}
+
+}  // namespace
+
+long long CoalescedMeasurePing() {
+  return PingFlight().Do([] { return MeasurePing(); });
+}
+
+void SetPingMinInterval(std::chrono::milliseconds interval) {
+  PingFlight().set_min_interval(interval);
+}
+
+void SetResultCacheRefreshPoster(std::function<bool(std::function<void()>)> post) {
+  std::lock_guard<std::mutex> lock(g_refresh_post_mutex);
+  g_refresh_post = std::move(post);
+}
+
+CoreString CachedGetFlag() {
+  return FlagCache().Get();
+}
+
+CoreString CachedGetFlowLine(bool isTest) {
+  return FlowLineCache(isTest).Get();
+}
+
+CoreString CachedGetCachedFlowLine() {
+  return CachedFlowLineCache().Get();
+}
+
+void CachedSetAsnName() {
+  AsnCache().Get();
+}
+
+void InvalidateResultCache() {
+  defyx_log::Debug("Invalidating core result cache");
+  FlagCache().Invalidate();
+  FlowLineCache(false).Invalidate();
+  FlowLineCache(true).Invalidate();
+  CachedFlowLineCache().Invalidate();
+  AsnCache().Invalidate();
+  // A ping taken on the old route says nothing about the new one.
+  PingFlight().Reset();
+}
+
+std::vector<ResultCacheStats> GetResultCacheStats() {
+  ResultCacheStats ping;
+  ping.name = "measurePing";
+  ping.hits = PingFlight().recent();
+  ping.misses = PingFlight().executed();
+  ping.joined = PingFlight().joined();
+  return {FlagCache().Stats(), FlowLineCache(false).Stats(), FlowLineCache(true).Stats(),
+          CachedFlowLineCache().Stats(), AsnCache().Stats(), ping,
+          GetVerifiedFlowlineCacheStats()};
+}
+
+}  // namespace defyx_core
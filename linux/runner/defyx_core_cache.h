@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "defyx_core.h"
+
+namespace defyx_core {
+
+// Cached front ends for the core lookups the UI repeats on every screen
+// change. A result younger than the call's TTL is returned as is; an older one
+// is still returned while a background refresh replaces it, up to a hard
+// staleness limit after which the caller waits for a fresh fetch. Fallback
+// values (core not loaded) are never cached.
+CoreString CachedGetFlag();
+CoreString CachedGetFlowLine(bool isTest = false);
+// The core's on-disk flowline; also what the startup prewarm fills in.
+CoreString CachedGetCachedFlowLine();
+// Remembers what the core verified for a given flowline, on disk in the core's
+// cache dir, for as long as the same core build is loaded. Failed
+// verifications are not cached. Lives in flowline_verify_cache.cpp.
+CoreString CachedDecodeAndVerifyFlowline(const std::string& flowLine);
+// Skips the core call if the ASN was set recently on the current connection.
+void CachedSetAsnName();
+
+// MeasurePing with concurrent callers sharing one probe. A result younger than
+// the minimum interval (1.5s, or DEFYX_PING_MIN_INTERVAL_MS) is returned again
+// without probing.
+long long CoalescedMeasurePing();
+void SetPingMinInterval(std::chrono::milliseconds interval);
+
+// Where stale-result refreshes run: |post| queues a task and returns false if
+// it was not accepted, in which case the stale value is served and a later
+// call tries again. Until one is set, and after it is cleared with nullptr,
+// stale values are served without refreshing.
+void SetResultCacheRefreshPoster(std::function<bool(std::function<void()>)> post);
+
+// Drops every cached result. Called on connection state changes, since the
+// flag, flowline and ASN all depend on the route the tunnel provides.
+void InvalidateResultCache();
+
+struct ResultCacheStats {
+  std::string name;
+  uint64_t hits = 0;        // fresh result served
+  uint64_t stale_hits = 0;  // stale result served, refresh started
+  uint64_t misses = 0;      // caller waited for the core
+  uint64_t refreshes = 0;   // background refreshes completed
+  uint64_t joined = 0;      // attached to a core call already in flight
+};
+
+std::vector<ResultCacheStats> GetResultCacheStats();
+ResultCacheStats GetVerifiedFlowlineCacheStats();
+
+}  // namespace defyx_core
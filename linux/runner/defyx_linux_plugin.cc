@@ -3,11 +3,21 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
-#include <thread>
+#include <string_view>
 #include <chrono>
+#include <functional>
 #include <memory>
+#include <vector>
 
+#include "cache_manager.h"
+#include "connect_trace.h"
+#include "connection_event.h"
 #include "defyx_core.h"
+#include "defyx_core_cache.h"
+#include "deadline_reply.h"
+#include "main_thread.h"
+#include "native_executor.h"
+#include "progress_pipeline.h"
 #include "proxy_manager.h"
 
 namespace {
@@ -17,33 +27,9 @@ constexpr int FLAG_TIMEOUT_MS = 3000;
 constexpr const char* DEFAULT_FLAG = "xx";
 constexpr int DEFAULT_PING = 999;
 
-struct AsyncPingTask {
-  FlMethodCall* method_call;
-  
-  AsyncPingTask(FlMethodCall* call) : method_call(call) {
-    g_object_ref(method_call);
-  }
-  
-  ~AsyncPingTask() {
-    if (method_call) {
-      g_object_unref(method_call);
-    }
-  }
-};
-
-struct AsyncFlagTask {
-  FlMethodCall* method_call;
-  
-  AsyncFlagTask(FlMethodCall* call) : method_call(call) {
-    g_object_ref(method_call);
-  }
-  
-  ~AsyncFlagTask() {
-    if (method_call) {
-      g_object_unref(method_call);
-    }
-  }
-};
+// Deadline outcomes for the plugin's ping/flag paths.
+DeadlineCounters g_ping_deadlines;
+DeadlineCounters g_flag_deadlines;
 
 void ProxyCleanupAtExit() {
   proxy::ResetSystemProxy();
@@ -55,6 +41,11 @@ struct PluginState {
   FlEventChannel* progress_channel = nullptr;
   bool status_listening = false;
   bool progress_listening = false;
+  uint64_t event_seq = 0;
+  // Created at registration and never destroyed: the registrar has no
+  // teardown hook, and joining at static destruction could hang exit.
+  NativeExecutor* executor = nullptr;
+  ProgressPipeline* progress_pipeline = nullptr;
 };
 
 PluginState g_state;
@@ -86,17 +77,74 @@ void SendStatus(PluginState* state, const std::string& status) {
   }
 }
 
-void SendProgress(PluginState* state, const std::string& message) {
-  if (!state->progress_listening || state->progress_channel == nullptr) {
+void SendProgress(PluginState* state, const std::vector<std::string>& messages) {
+  if (!state->progress_listening || state->progress_channel == nullptr || messages.empty()) {
     return;
   }
-  g_autoptr(FlValue) value = fl_value_new_string(message.c_str());
+  g_autoptr(FlValue) value = fl_value_new_list();
+  for (const auto& message : messages) {
+    fl_value_append_take(value, fl_value_new_string_sized(message.data(), message.size()));
+  }
   g_autoptr(GError) error = nullptr;
   if (!fl_event_channel_send(state->progress_channel, value, nullptr, &error)) {
     g_warning("Failed to send progress event: %s", error->message);
   }
 }
 
+// Typed form of the state lines in |messages|, sent on the status channel.
+void SendEvents(PluginState* state, const std::vector<std::string>& messages) {
+  if (!state->status_listening || state->status_channel == nullptr) {
+    return;
+  }
+  for (const auto& message : messages) {
+    connection_event::Event event = connection_event::Classify(message);
+    if (event.code == connection_event::Code::kNone) {
+      continue;
+    }
+    g_autoptr(FlValue) payload = fl_value_new_map();
+    fl_value_set_string_take(payload, "event", fl_value_new_int(static_cast<int64_t>(event.code)));
+    fl_value_set_string_take(payload, "name", fl_value_new_string(connection_event::Name(event.code)));
+    fl_value_set_string_take(payload, "seq", fl_value_new_int(static_cast<int64_t>(++state->event_seq)));
+    fl_value_set_string_take(payload, "ts", fl_value_new_int(g_get_monotonic_time() / 1000));
+    if (event.value >= 0) {
+      fl_value_set_string_take(payload, "value", fl_value_new_int(event.value));
+    }
+    if (!event.text.empty()) {
+      fl_value_set_string_take(payload, "text", fl_value_new_string_sized(event.text.data(), event.text.size()));
+    }
+    g_autoptr(GError) error = nullptr;
+    if (!fl_event_channel_send(state->status_channel, payload, nullptr, &error)) {
+      g_warning("Failed to send connection event: %s", error->message);
+    }
+  }
+}
+
+// Ends the connect trace on the core's outcome lines, as VPNChannelHandler
+// does. StartVPN returning only means the attempt is under way.
+void EndTraceOnOutcome(PluginState* state, const std::vector<std::string>& messages) {
+  for (const auto& message : messages) {
+    const char* outcome = nullptr;
+    switch (connection_event::Classify(message).code) {
+      case connection_event::Code::kConnected:
+        outcome = "connected";
+        break;
+      case connection_event::Code::kFailed:
+        outcome = "failed";
+        break;
+      case connection_event::Code::kStopped:
+      case connection_event::Code::kCancelled:
+        outcome = "stopped";
+        break;
+      default:
+        break;
+    }
+    if (outcome != nullptr) {
+      state->executor->Post(NativeExecutor::Lane::kBackground,
+                            [outcome]() { connect_trace::EndSession(outcome); });
+    }
+  }
+}
+
 void FinishWithResponse(FlMethodCall* method_call, FlMethodResponse* response) {
   if (method_call == nullptr || response == nullptr) {
     g_warning("FinishWithResponse called with null parameters");
@@ -119,8 +167,11 @@ void FinishWithBool(FlMethodCall* method_call, bool value) {
   FinishWithSuccess(method_call, fl_value_new_bool(value));
 }
 
-void FinishWithString(FlMethodCall* method_call, const std::string& value) {
-  FinishWithSuccess(method_call, fl_value_new_string(value.c_str()));
+// Copies |value| into the reply exactly once; callers can pass a
+// defyx_core::CoreString view straight through.
+void FinishWithString(FlMethodCall* method_call, std::string_view value) {
+  g_autoptr(FlValue) result = fl_value_new_string_sized(value.data(), value.size());
+  FinishWithSuccess(method_call, result);
 }
 
 void FinishWithInt(FlMethodCall* method_call, int64_t value) {
@@ -143,43 +194,13 @@ void FinishNotImplemented(FlMethodCall* method_call) {
   FinishWithResponse(method_call, response);
 }
 
-gboolean DeliverPingResult(gpointer user_data) {
-  auto* data = static_cast<std::pair<AsyncPingTask*, int>*>(user_data);
-  auto* task = data->first;
-  int ping_result = data->second;
-  
-  FinishWithInt(task->method_call, static_cast<int64_t>(ping_result));
-  
-  delete task;
-  delete data;
-  return FALSE;
-}
-
-gboolean DeliverFlagResult(gpointer user_data) {
-  auto* data = static_cast<std::pair<AsyncFlagTask*, std::string>*>(user_data);
-  auto* task = data->first;
-  std::string flag_result = data->second;
-  
-  FinishWithString(task->method_call, flag_result);
-  
-  delete task;
-  delete data;
-  return FALSE;
-}
-
-void ExecutePingInBackground(AsyncPingTask* task) {
+void MeasurePingInBackground(std::shared_ptr<DeadlineReply> reply) {
   int ping_result = DEFAULT_PING;
   
   try {
-    auto start_time = std::chrono::steady_clock::now();
-    long long core_ping = defyx_core::MeasurePing();
-    auto end_time = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    long long core_ping = defyx_core::CoalescedMeasurePing();
     
-    if (duration.count() > PING_TIMEOUT_MS) {
-      ping_result = DEFAULT_PING;
-    }
-    else if (core_ping <= 0) {
+    if (core_ping <= 0) {
       ping_result = DEFAULT_PING;
     }
     else if (core_ping > 9999) {
@@ -195,27 +216,20 @@ void ExecutePingInBackground(AsyncPingTask* task) {
     ping_result = DEFAULT_PING;
   }
   
-  auto* result_data = new std::pair<AsyncPingTask*, int>(task, ping_result);
-  g_idle_add(DeliverPingResult, result_data);
+  DeadlineReply::Complete(std::move(reply), fl_value_new_int(ping_result));
 }
 
-void ExecuteFlagInBackground(AsyncFlagTask* task) {
+void GetFlagInBackground(std::shared_ptr<DeadlineReply> reply) {
   std::string flag_result = DEFAULT_FLAG;
   
   try {
-    auto start_time = std::chrono::steady_clock::now();
-    std::string core_flag = defyx_core::GetFlag();
-    auto end_time = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    defyx_core::CoreString core_flag = defyx_core::CachedGetFlag();
     
-    if (duration.count() > FLAG_TIMEOUT_MS) {
-      flag_result = DEFAULT_FLAG;
-    }
-    else if (core_flag.empty() || core_flag.length() > 10) {
+    if (core_flag.empty() || core_flag.size() > 10) {
       flag_result = DEFAULT_FLAG;
     }
     else {
-      flag_result = core_flag;
+      flag_result = core_flag.str();
     }
     
   } catch (const std::exception& e) {
@@ -224,8 +238,31 @@ void ExecuteFlagInBackground(AsyncFlagTask* task) {
     flag_result = DEFAULT_FLAG;
   }
   
-  auto* result_data = new std::pair<AsyncFlagTask*, std::string>(task, flag_result);
-  g_idle_add(DeliverFlagResult, result_data);
+  DeadlineReply::Complete(std::move(reply), fl_value_new_string(flag_result.c_str()));
+}
+
+// Runs |work| on |lane| and sends the reply it returns from the GTK main
+// thread. Answers BUSY straight away if the lane is full.
+using MainThreadReply = std::function<void(FlMethodCall*)>;
+void RunBlocking(PluginState* state,
+                 FlMethodCall* method_call,
+                 NativeExecutor::Lane lane,
+                 std::function<MainThreadReply()> work) {
+  std::shared_ptr<FlMethodCall> call(FL_METHOD_CALL(g_object_ref(method_call)), g_object_unref);
+  bool posted = state->executor->Post(lane, [call, work = std::move(work)]() {
+    MainThreadReply reply;
+    try {
+      reply = work();
+    } catch (...) {
+      reply = [](FlMethodCall* c) {
+        FinishWithError(c, "INTERNAL_ERROR", "Method execution failed");
+      };
+    }
+    main_thread::Invoke([call, reply = std::move(reply)]() { reply(call.get()); });
+  });
+  if (!posted) {
+    FinishWithError(method_call, "BUSY", "Native executor queue is full");
+  }
 }
 
 void HandleMethodCall(FlMethodChannel* channel,
@@ -240,33 +277,53 @@ void HandleMethodCall(FlMethodChannel* channel,
       SendStatus(state, "connected");
       FinishWithBool(method_call, true);
     } else if (strcmp(method, "disconnect") == 0) {
-      bool ok = defyx_core::StopVPN();
-      SendStatus(state, ok ? "disconnected" : "disconnect_failed");
-      FinishWithBool(method_call, ok);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [state]() {
+        bool ok = defyx_core::StopVPN();
+        return [state, ok](FlMethodCall* call) {
+          SendStatus(state, ok ? "disconnected" : "disconnect_failed");
+          FinishWithBool(call, ok);
+        };
+      });
     } else if (strcmp(method, "isVPNPrepared") == 0) {
       FinishWithBool(method_call, true);
     } else if (strcmp(method, "prepareVPN") == 0 || strcmp(method, "prepare") == 0) {
       FinishWithBool(method_call, true);
     } else if (strcmp(method, "startTun2socks") == 0) {
-      defyx_core::StartTun2Socks(0, "127.0.0.1:0");
-      FinishWithNull(method_call);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, []() {
+        defyx_core::StartTun2Socks(0, "127.0.0.1:0");
+        return [](FlMethodCall* call) { FinishWithNull(call); };
+      });
     } else if (strcmp(method, "getVpnStatus") == 0) {
-      std::string status = defyx_core::GetVpnStatus();
-      if (status.empty()) {
-        status = "disconnected";
-      }
-      FinishWithString(method_call, status);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kBackground, []() {
+        auto status = std::make_shared<defyx_core::CoreString>(defyx_core::GetVpnStatus());
+        return [status](FlMethodCall* call) {
+          FinishWithString(call, status->empty() ? std::string_view("disconnected") : status->view());
+        };
+      });
     } else if (strcmp(method, "isTunnelRunning") == 0) {
-      FinishWithBool(method_call, defyx_core::IsTunnelRunning());
+      RunBlocking(state, method_call, NativeExecutor::Lane::kBackground, []() {
+        bool running = defyx_core::IsTunnelRunning();
+        return [running](FlMethodCall* call) { FinishWithBool(call, running); };
+      });
     } else if (strcmp(method, "stopTun2Socks") == 0) {
-      defyx_core::StopTun2Socks();
-      FinishWithBool(method_call, true);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, []() {
+        defyx_core::StopTun2Socks();
+        return [](FlMethodCall* call) { FinishWithBool(call, true); };
+      });
     } else if (strcmp(method, "calculatePing") == 0) {
-      auto* ping_task = new AsyncPingTask(method_call);
-      std::thread(ExecutePingInBackground, ping_task).detach();
+      auto reply = DeadlineReply::Start(method_call, PING_TIMEOUT_MS,
+                                        fl_value_new_int(DEFAULT_PING), &g_ping_deadlines);
+      if (!state->executor->Post(NativeExecutor::Lane::kBackground,
+                                 [reply]() { MeasurePingInBackground(reply); })) {
+        DeadlineReply::Complete(reply, fl_value_new_int(DEFAULT_PING));
+      }
     } else if (strcmp(method, "getFlag") == 0) {
-      auto* flag_task = new AsyncFlagTask(method_call);
-      std::thread(ExecuteFlagInBackground, flag_task).detach();
+      auto reply = DeadlineReply::Start(method_call, FLAG_TIMEOUT_MS,
+                                        fl_value_new_string(DEFAULT_FLAG), &g_flag_deadlines);
+      if (!state->executor->Post(NativeExecutor::Lane::kBackground,
+                                 [reply]() { GetFlagInBackground(reply); })) {
+        DeadlineReply::Complete(reply, fl_value_new_string(DEFAULT_FLAG));
+      }
     } else if (strcmp(method, "startVPN") == 0) {
       FlValue* args = fl_method_call_get_args(method_call);
       std::string flowLine = LookupString(args, "flowLine");
@@ -277,43 +334,95 @@ void HandleMethodCall(FlMethodChannel* channel,
         return;
       }
       
-      const std::string cacheDir = "/tmp/defyx/cache";
-      bool ok = defyx_core::StartVPN(cacheDir, flowLine, pattern);
-      SendStatus(state, ok ? "connected" : "disconnected");
-      FinishWithBool(method_call, ok);
+      connect_trace::BeginSession();
+      connect_trace::Instant("startVPN", "ui");
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [state, flowLine, pattern]() {
+        const std::string cacheDir = cache_manager::CoreDir();
+        bool ok;
+        {
+          connect_trace::Span span("core.StartVPN", "core");
+          ok = defyx_core::StartVPN(cacheDir, flowLine, pattern);
+        }
+        return [state, ok](FlMethodCall* call) {
+          SendStatus(state, ok ? "connected" : "disconnected");
+          FinishWithBool(call, ok);
+        };
+      });
     } else if (strcmp(method, "loadCore") == 0) {
       FlValue* args = fl_method_call_get_args(method_call);
       std::string path;
       if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_STRING) {
         path = fl_value_get_string(args);
       }
-      FinishWithBool(method_call, defyx_core::LoadCoreDll(path));
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [path]() {
+        bool ok = defyx_core::LoadCoreDll(path);
+        return [ok](FlMethodCall* call) { FinishWithBool(call, ok); };
+      });
+    } else if (strcmp(method, "dumpConnectTrace") == 0) {
+      FlValue* args = fl_method_call_get_args(method_call);
+      int64_t id = 0;
+      if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+        FlValue* value = fl_value_lookup_string(args, "id");
+        if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+          id = fl_value_get_int(value);
+        }
+      }
+      FinishWithString(method_call, connect_trace::DumpJson(id > 0 ? static_cast<uint64_t>(id) : 0));
+    } else if (strcmp(method, "reloadCore") == 0) {
+      FlValue* args = fl_method_call_get_args(method_call);
+      std::string path = LookupString(args, "path");
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [path]() {
+        std::string error;
+        bool ok = defyx_core::ReloadCoreDll(path, &error);
+        return [ok, error](FlMethodCall* call) {
+          if (ok) {
+            FinishWithBool(call, true);
+          } else {
+            FinishWithError(call, error.c_str(), "Core reload failed; previous core still in use");
+          }
+        };
+      });
     } else if (strcmp(method, "unloadCore") == 0) {
       defyx_core::LogMessage("Unload core requested");
-      defyx_core::UnloadCoreDll();
-      FinishWithBool(method_call, true);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, []() {
+        defyx_core::UnloadCoreDll();
+        return [](FlMethodCall* call) { FinishWithBool(call, true); };
+      });
     } else if (strcmp(method, "stopVPN") == 0) {
       defyx_core::LogMessage("StopVPN requested via method channel");
-      bool ok = defyx_core::StopVPN();
-      SendStatus(state, "disconnected");
-      FinishWithBool(method_call, ok);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [state]() {
+        bool ok = defyx_core::StopVPN();
+        return [state, ok](FlMethodCall* call) {
+          SendStatus(state, "disconnected");
+          FinishWithBool(call, ok);
+        };
+      });
     } else if (strcmp(method, "grantVpnPermission") == 0) {
       FinishWithBool(method_call, true);
     } else if (strcmp(method, "setAsnName") == 0) {
-      defyx_core::SetAsnName();
-      FinishWithString(method_call, "success");
+      RunBlocking(state, method_call, NativeExecutor::Lane::kBackground, []() {
+        defyx_core::CachedSetAsnName();
+        return [](FlMethodCall* call) { FinishWithString(call, "success"); };
+      });
     } else if (strcmp(method, "setTimezone") == 0) {
       FlValue* args = fl_method_call_get_args(method_call);
       std::string tz_string = LookupString(args, "timezone");
       if (!tz_string.empty()) {
+        float tz = 0;
+        bool parsed = false;
         try {
-          float tz = std::stof(tz_string);
-          defyx_core::SetTimeZone(tz);
-          FinishWithBool(method_call, true);
-          return;
+          tz = std::stof(tz_string);
+          parsed = true;
         } catch (...) {
           // Fall through to error
         }
+        if (parsed) {
+          RunBlocking(state, method_call, NativeExecutor::Lane::kBackground, [tz]() {
+            defyx_core::SetTimeZone(tz);
+            return [](FlMethodCall* call) { FinishWithBool(call, true); };
+          });
+          return;
+        }
       }
       FinishWithError(method_call, "INVALID_ARGUMENT", "timezone missing or invalid");
     } else if (strcmp(method, "getFlowLine") == 0) {
@@ -321,24 +430,31 @@ void HandleMethodCall(FlMethodChannel* channel,
       std::string is_test_str = LookupString(args, "isTest");
       bool is_test = (is_test_str == "true" || is_test_str == "1");
 
-      std::string flowLine = defyx_core::GetFlowLine(is_test);
-      if (flowLine.empty()) {
-        flowLine = "{}";
-      }
-      FinishWithString(method_call, flowLine);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kBackground, [is_test]() {
+        auto flowLine = std::make_shared<defyx_core::CoreString>(defyx_core::CachedGetFlowLine(is_test));
+        return [flowLine](FlMethodCall* call) {
+          FinishWithString(call, flowLine->empty() ? std::string_view("{}") : flowLine->view());
+        };
+      });
     } else if (strcmp(method, "getCachedFlowLine") == 0) {
-      std::string flowLine = defyx_core::GetCachedFlowLine();
-      if (flowLine.empty()) {
-        FinishWithError(method_call, "GET_CACHED_FLOW_LINE_ERROR", "Failed to get cached flow line");
-      } else {
-        FinishWithString(method_call, flowLine);
-      }
+      RunBlocking(state, method_call, NativeExecutor::Lane::kBackground, []() {
+        auto flowLine = std::make_shared<defyx_core::CoreString>(defyx_core::CachedGetCachedFlowLine());
+        return [flowLine](FlMethodCall* call) {
+          if (flowLine->empty()) {
+            FinishWithError(call, "GET_CACHED_FLOW_LINE_ERROR", "Failed to get cached flow line");
+          } else {
+            FinishWithString(call, flowLine->view());
+          }
+        };
+      });
     } else if (strcmp(method, "setConnectionMethod") == 0) {
       FlValue* args = fl_method_call_get_args(method_call);
       std::string method_name = LookupString(args, "method");
       if (!method_name.empty()) {
-        defyx_core::SetConnectionMethod(method_name);
-        FinishWithBool(method_call, true);
+        RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [method_name]() {
+          defyx_core::SetConnectionMethod(method_name);
+          return [](FlMethodCall* call) { FinishWithBool(call, true); };
+        });
       } else {
         FinishWithError(method_call, "INVALID_ARGUMENT", "method parameter missing");
       }
@@ -370,11 +486,15 @@ void HandleMethodCall(FlMethodChannel* channel,
       config.port = port;
       config.scheme = scheme.empty() ? "http" : scheme;
       config.no_proxy = no_proxy;
-      bool ok = proxy::ApplySystemProxy(config);
-      FinishWithBool(method_call, ok);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, [config]() {
+        bool ok = proxy::ApplySystemProxy(config);
+        return [ok](FlMethodCall* call) { FinishWithBool(call, ok); };
+      });
     } else if (strcmp(method, "resetSystemProxy") == 0) {
-      proxy::ResetSystemProxy();
-      FinishWithBool(method_call, true);
+      RunBlocking(state, method_call, NativeExecutor::Lane::kCritical, []() {
+        proxy::ResetSystemProxy();
+        return [](FlMethodCall* call) { FinishWithBool(call, true); };
+      });
     } else {
       FinishNotImplemented(method_call);
     }
@@ -391,7 +511,13 @@ FlMethodErrorResponse* StatusListen(FlEventChannel* channel,
   PluginState* state = GetState(user_data);
   state->status_listening = true;
   defyx_core::LogMessage("Status event stream: OnListen");
-  SendStatus(state, "disconnected");
+  // Report what the core says rather than assuming "disconnected". Asking
+  // may load the core, so it happens on the executor; nothing is sent if the
+  // lane is full.
+  state->executor->Post(NativeExecutor::Lane::kBackground, [state]() {
+    bool running = defyx_core::IsTunnelRunning();
+    main_thread::Invoke([state, running]() { SendStatus(state, running ? "connected" : "disconnected"); });
+  });
   return nullptr;
 }
 
@@ -411,12 +537,7 @@ FlMethodErrorResponse* ProgressListen(FlEventChannel* channel,
   defyx_core::LogMessage("Progress event stream: OnListen");
   
   defyx_core::RegisterProgressHandler([state](std::string msg) {
-    g_idle_add([](gpointer data) -> gboolean {
-      auto* msg_data = static_cast<std::pair<PluginState*, std::string>*>(data);
-      SendProgress(msg_data->first, msg_data->second);
-      delete msg_data;
-      return FALSE;
-    }, new std::pair<PluginState*, std::string>(state, msg));
+    state->progress_pipeline->Push(std::move(msg));
   });
   
   defyx_core::EnableVerboseLogs(true);
@@ -436,15 +557,30 @@ FlMethodErrorResponse* ProgressCancel(FlEventChannel* channel,
 }  // namespace
 
 void RegisterDefyxLinuxPlugin(FlPluginRegistrar* registrar) {
+  PluginState* state = &g_state;
+  if (state->executor == nullptr) {
+    state->executor = new NativeExecutor(2, 16, 32);
+  }
+  if (state->progress_pipeline == nullptr) {
+    state->progress_pipeline = new ProgressPipeline(
+        [state](std::vector<std::string>& batch) {
+          SendProgress(state, batch);
+          SendEvents(state, batch);
+          EndTraceOnOutcome(state, batch);
+        });
+  }
+
   static bool proxy_cleanup_registered = false;
   if (!proxy_cleanup_registered) {
-    proxy::RestorePendingSnapshot();
+    // Off the GTK thread. This doesn't order it before setSystemProxy: the
+    // VPN handler runs that on its own executor. RestorePendingSnapshot does
+    // nothing once a proxy has been applied in this process.
+    state->executor->Post(NativeExecutor::Lane::kCritical,
+                          []() { proxy::RestorePendingSnapshot(); });
     std::atexit(ProxyCleanupAtExit);
     proxy_cleanup_registered = true;
   }
 
-  PluginState* state = &g_state;
-
   if (state->method_channel != nullptr) {
     g_object_unref(state->method_channel);
     state->method_channel = nullptr;
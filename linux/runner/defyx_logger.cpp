@@ -0,0 +1,548 @@
+#include "defyx_logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace defyx_log {
+
+namespace {
+
+// Ring geometry. Slots are fixed-size so memory use is bounded no matter how
+// chatty the core gets; longer lines are truncated.
+constexpr size_t kRingSlots = 2048;  // must be a power of two
+constexpr size_t kRingMask = kRingSlots - 1;
+constexpr size_t kMaxLineBytes = 1000;
+constexpr size_t kWakeThreshold = kRingSlots / 4;
+constexpr size_t kBatchBytes = 64 * 1024;
+constexpr auto kFlushInterval = std::chrono::milliseconds(100);
+
+// Rotation defaults; DEFYX_LOG_MAX_BYTES / DEFYX_LOG_MAX_FILES override them.
+// The file count includes the active log.
+constexpr uint64_t kDefaultMaxFileBytes = 4 * 1024 * 1024;
+constexpr size_t kDefaultMaxFiles = 5;
+constexpr const char* kLogFileName = "defyx_linux.log";
+
+// Entries kept in memory for getNativeLogs.
+constexpr size_t kTailEntries = 4096;
+
+static_assert((kRingSlots & kRingMask) == 0, "kRingSlots must be a power of two");
+
+struct Slot {
+  std::atomic<size_t> sequence{0};
+  int64_t timestamp_ms = 0;
+  uint32_t length = 0;
+  Level level = Level::kInfo;
+  char text[kMaxLineBytes];
+};
+
+int64_t NowMs() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+std::string HomeDir() {
+  const char* home = std::getenv("HOME");
+  if (home && *home) return home;
+  struct passwd* pw = getpwuid(getuid());
+  if (pw && pw->pw_dir) return pw->pw_dir;
+  return "";
+}
+
+std::string ExeDir() {
+  char exePath[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", exePath, sizeof(exePath) - 1);
+  if (len == -1) return "";
+  exePath[len] = '\0';
+  std::string path(exePath);
+  size_t pos = path.find_last_of('/');
+  if (pos == std::string::npos) return "";
+  return path.substr(0, pos + 1);
+}
+
+// $XDG_STATE_HOME/defyx (~/.local/state/defyx) so the log stays writable when
+// the bundle is installed read-only under /opt. Falls back to the exe dir.
+std::string LogDirectory() {
+  std::string base;
+  const char* xdg_state = std::getenv("XDG_STATE_HOME");
+  if (xdg_state && *xdg_state) {
+    base = xdg_state;
+  } else {
+    std::string home = HomeDir();
+    if (!home.empty()) base = home + "/.local/state";
+  }
+
+  if (!base.empty()) {
+    std::string dir = base + "/defyx";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (!ec && access(dir.c_str(), W_OK) == 0) return dir + "/";
+  }
+  return ExeDir();
+}
+
+uint64_t EnvNumber(const char* name, uint64_t fallback) {
+  const char* raw = std::getenv(name);
+  if (!raw || !*raw) return fallback;
+  char* end = nullptr;
+  unsigned long long value = std::strtoull(raw, &end, 10);
+  if (end == raw || value == 0) return fallback;
+  return value;
+}
+
+const char* LevelTag(Level level) {
+  switch (level) {
+    case Level::kTrace: return "TRACE";
+    case Level::kDebug: return "DEBUG";
+    case Level::kInfo: return "INFO";
+    case Level::kWarn: return "WARN";
+    case Level::kError: return "ERROR";
+  }
+  return "INFO";
+}
+
+void AppendLine(std::string* out, int64_t timestamp_ms, Level level, const char* text, size_t length) {
+  char prefix[48];
+  int n = std::snprintf(prefix, sizeof(prefix), "%lld | %s | ",
+                        static_cast<long long>(timestamp_ms), LevelTag(level));
+  if (n > 0) out->append(prefix, static_cast<size_t>(n));
+  out->append(text, length);
+  out->push_back('\n');
+}
+
+// Gzips rotated segments and prunes old ones on a nice(19) background thread so
+// the flusher only ever pays for a rename.
+class SegmentCompressor {
+ public:
+  SegmentCompressor(std::string dir, size_t keep) : dir_(std::move(dir)), keep_(keep) {}
+
+  ~SegmentCompressor() { Stop(); }
+
+  void Submit(const std::string& segment) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) return;
+      pending_.push_back(segment);
+      if (!worker_.joinable()) {
+        worker_ = std::thread(&SegmentCompressor::Run, this);
+      }
+    }
+    cv_.notify_one();
+  }
+
+  // Finishes queued work and joins the worker.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_one();
+    if (worker_.joinable()) worker_.join();
+  }
+
+ private:
+  void Run() {
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+    for (;;) {
+      std::string segment;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) return;
+        segment = pending_.front();
+        pending_.pop_front();
+      }
+      Compress(segment);
+      Prune();
+    }
+  }
+
+  static void Compress(const std::string& segment) {
+    int in = open(segment.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return;
+    std::string target = segment + ".gz";
+    gzFile out = gzopen(target.c_str(), "wb6");
+    if (!out) {
+      close(in);
+      return;
+    }
+    bool ok = true;
+    char buffer[64 * 1024];
+    for (;;) {
+      ssize_t n = read(in, buffer, sizeof(buffer));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        ok = n == 0;
+        break;
+      }
+      if (gzwrite(out, buffer, static_cast<unsigned>(n)) != n) {
+        ok = false;
+        break;
+      }
+    }
+    close(in);
+    if (gzclose(out) != Z_OK) ok = false;
+
+    std::error_code ec;
+    std::filesystem::remove(ok ? segment : target, ec);
+  }
+
+  // Keeps the newest keep_ - 1 rotated segments (names sort by timestamp).
+  void Prune() {
+    std::vector<std::string> segments;
+    std::error_code ec;
+    const std::string prefix = std::string(kLogFileName) + ".";
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+      std::string name = entry.path().filename().string();
+      if (name.compare(0, prefix.size(), prefix) == 0) {
+        segments.push_back(entry.path().string());
+      }
+    }
+    if (segments.size() + 1 <= keep_) return;
+    std::sort(segments.begin(), segments.end());
+    size_t excess = segments.size() + 1 - keep_;
+    for (size_t i = 0; i < excess; ++i) {
+      std::filesystem::remove(segments[i], ec);
+    }
+  }
+
+  std::string dir_;
+  size_t keep_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> pending_;
+  bool stopping_ = false;
+  std::thread worker_;
+};
+
+// Bounded multi-producer / single-consumer ring (Vyukov sequence scheme).
+// Producers claim a slot with one CAS and never wait; the flusher thread is the
+// only consumer and owns the file descriptor.
+class AsyncLogger {
+ public:
+  AsyncLogger()
+      : dir_(LogDirectory()),
+        path_(dir_ + kLogFileName),
+        max_file_bytes_(EnvNumber("DEFYX_LOG_MAX_BYTES", kDefaultMaxFileBytes)),
+        compressor_(dir_.empty() ? "." : dir_,
+                    static_cast<size_t>(EnvNumber("DEFYX_LOG_MAX_FILES", kDefaultMaxFiles))) {
+    for (size_t i = 0; i < kRingSlots; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    tail_.resize(kTailEntries);
+    flusher_ = std::thread(&AsyncLogger::Run, this);
+  }
+
+  std::string path() const { return path_; }
+
+  std::vector<Entry> Tail(uint64_t since_seq, size_t max_count, Level min_level,
+                          uint64_t* latest_seq) {
+    std::vector<Entry> result;
+    std::lock_guard<std::mutex> lock(tail_mutex_);
+    if (latest_seq) *latest_seq = tail_next_seq_ - 1;
+
+    uint64_t oldest = tail_next_seq_ > kTailEntries ? tail_next_seq_ - kTailEntries : 1;
+    uint64_t seq = since_seq + 1 > oldest ? since_seq + 1 : oldest;
+    for (; seq < tail_next_seq_ && result.size() < max_count; ++seq) {
+      const Entry& entry = tail_[seq % kTailEntries];
+      if (entry.level < min_level) continue;
+      result.push_back(entry);
+    }
+    return result;
+  }
+
+  void Enqueue(Level level, const std::string& msg) {
+    int64_t timestamp_ms = NowMs();
+
+    if (direct_.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(io_mutex_);
+      std::string line;
+      AppendLine(&line, timestamp_ms, level, msg.data(), msg.size());
+      WriteOut(line);
+      return;
+    }
+
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+      slot = &slots_[pos & kRingMask];
+      size_t seq = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    size_t length = msg.size() < kMaxLineBytes ? msg.size() : kMaxLineBytes;
+    std::memcpy(slot->text, msg.data(), length);
+    slot->length = static_cast<uint32_t>(length);
+    slot->timestamp_ms = timestamp_ms;
+    slot->level = level;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Errors are flushed promptly so they survive a crash right after.
+    size_t backlog = pos + 1 - dequeue_pos_.load(std::memory_order_relaxed);
+    bool urgent = level >= Level::kError || backlog >= kWakeThreshold;
+    if (urgent && !wake_.exchange(true, std::memory_order_acq_rel)) {
+      wait_cv_.notify_one();
+    }
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  void Shutdown() {
+    if (direct_.exchange(true, std::memory_order_acq_rel)) return;
+    {
+      std::lock_guard<std::mutex> lock(wait_mutex_);
+      stopping_ = true;
+    }
+    wait_cv_.notify_one();
+    if (flusher_.joinable()) flusher_.join();
+
+    // Pick up anything a producer queued between the switch and the join.
+    {
+      std::lock_guard<std::mutex> lock(io_mutex_);
+      std::string batch;
+      DrainAndWrite(&batch);
+    }
+    compressor_.Stop();
+  }
+
+ private:
+  void Run() {
+    std::string batch;
+    batch.reserve(kBatchBytes);
+    for (;;) {
+      bool stopping = false;
+      {
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        wait_cv_.wait_for(lock, kFlushInterval, [this] {
+          return stopping_ || wake_.load(std::memory_order_acquire);
+        });
+        stopping = stopping_;
+      }
+      wake_.store(false, std::memory_order_release);
+      {
+        std::lock_guard<std::mutex> lock(io_mutex_);
+        DrainAndWrite(&batch);
+      }
+      if (stopping) return;
+    }
+  }
+
+  bool TryDequeue(std::string* batch) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Slot* slot = &slots_[pos & kRingMask];
+    size_t seq = slot->sequence.load(std::memory_order_acquire);
+    if (seq != pos + 1) return false;
+
+    AppendLine(batch, slot->timestamp_ms, slot->level, slot->text, slot->length);
+    RecordTail(slot->timestamp_ms, slot->level, slot->text, slot->length);
+    slot->sequence.store(pos + kRingSlots, std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void DrainAndWrite(std::string* batch) {
+    batch->clear();
+    while (TryDequeue(batch)) {
+      if (batch->size() >= kBatchBytes) {
+        WriteOut(*batch);
+        batch->clear();
+      }
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_dropped_) {
+      std::string note = "[logger] dropped " + std::to_string(dropped - reported_dropped_) +
+                         " messages (ring full)";
+      int64_t now = NowMs();
+      AppendLine(batch, now, Level::kWarn, note.data(), note.size());
+      RecordTail(now, Level::kWarn, note.data(), note.size());
+      reported_dropped_ = dropped;
+    }
+
+    if (!batch->empty()) {
+      WriteOut(*batch);
+      batch->clear();
+    }
+  }
+
+  // Slots are reused in place, so the strings keep their capacity and the
+  // tail stays at a fixed footprint once warmed up.
+  void RecordTail(int64_t timestamp_ms, Level level, const char* text, size_t length) {
+    std::lock_guard<std::mutex> lock(tail_mutex_);
+    Entry& entry = tail_[tail_next_seq_ % kTailEntries];
+    entry.seq = tail_next_seq_++;
+    entry.timestamp_ms = timestamp_ms;
+    entry.level = level;
+    entry.text.assign(text, length);
+  }
+
+  bool EnsureOpen() {
+    if (fd_ >= 0) return true;
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) return false;
+    struct stat st;
+    file_bytes_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    return true;
+  }
+
+  // Moves the active file aside under a timestamped name and hands it to the
+  // compressor; the next write reopens a fresh file.
+  void Rotate() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    std::string segment = path_ + "." + std::to_string(NowMs());
+    if (rename(path_.c_str(), segment.c_str()) == 0) {
+      compressor_.Submit(segment);
+    }
+    file_bytes_ = 0;
+  }
+
+  void WriteOut(const std::string& data) {
+    if (!EnsureOpen()) return;
+    if (file_bytes_ > 0 && file_bytes_ + data.size() > max_file_bytes_) {
+      Rotate();
+      if (!EnsureOpen()) return;
+    }
+    const char* p = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+      ssize_t written = write(fd_, p, remaining);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        close(fd_);
+        fd_ = -1;
+        return;
+      }
+      p += written;
+      remaining -= static_cast<size_t>(written);
+      file_bytes_ += static_cast<uint64_t>(written);
+    }
+  }
+
+  Slot slots_[kRingSlots];
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+  std::atomic<uint64_t> dropped_{0};
+  uint64_t reported_dropped_ = 0;
+
+  std::atomic<bool> wake_{false};
+  std::atomic<bool> direct_{false};
+  bool stopping_ = false;
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cv_;
+  std::thread flusher_;
+
+  // Guards fd_. Uncontended while the flusher runs; after Shutdown() it
+  // serialises the direct writers.
+  std::mutex io_mutex_;
+  std::string dir_;
+  std::string path_;
+  uint64_t max_file_bytes_;
+  uint64_t file_bytes_ = 0;
+  int fd_ = -1;
+  SegmentCompressor compressor_;
+
+  // Guards the in-memory tail; written by the flusher only.
+  std::mutex tail_mutex_;
+  std::vector<Entry> tail_;
+  uint64_t tail_next_seq_ = 1;
+};
+
+bool ApplyEnvironmentLevel() {
+  const char* raw = std::getenv("DEFYX_LOG_LEVEL");
+  if (!raw || !*raw) return false;
+  std::string value(raw);
+  if (value == "trace") SetLevel(Level::kTrace);
+  else if (value == "debug") SetLevel(Level::kDebug);
+  else if (value == "info") SetLevel(Level::kInfo);
+  else if (value == "warn") SetLevel(Level::kWarn);
+  else if (value == "error") SetLevel(Level::kError);
+  else return false;
+  return true;
+}
+
+const bool g_env_level_applied = ApplyEnvironmentLevel();
+
+// Intentionally leaked: logging must keep working from atexit handlers and
+// static destructors that run after a function-local static would be gone.
+AsyncLogger& Instance() {
+  static AsyncLogger* logger = new AsyncLogger();
+  return *logger;
+}
+
+}  // namespace
+
+void Write(Level level, const std::string& msg) {
+  Instance().Enqueue(level, msg);
+}
+
+uint64_t DroppedCount() {
+  return Instance().dropped();
+}
+
+void Shutdown() {
+  Instance().Shutdown();
+}
+
+std::string LogFilePath() {
+  return Instance().path();
+}
+
+std::vector<Entry> Tail(uint64_t since_seq, size_t max_count, Level min_level,
+                        uint64_t* latest_seq) {
+  return Instance().Tail(since_seq, max_count, min_level, latest_seq);
+}
+
+namespace internal {
+
+uint64_t HashBytes(std::string_view data) {
+  // FNV-1a, 64-bit: cheap and good enough to tell payloads apart in logs.
+  uint64_t hash = 1469598103934665603ULL;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void Append(std::string* out, Payload value) {
+  char buffer[64];
+  int n = std::snprintf(buffer, sizeof(buffer), "<%zu bytes fnv1a=%016llx>", value.data.size(),
+                        static_cast<unsigned long long>(HashBytes(value.data)));
+  if (n > 0) out->append(buffer, static_cast<size_t>(n));
+}
+
+}  // namespace internal
+
+}  // namespace defyx_log
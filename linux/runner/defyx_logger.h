@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Levels below this are compiled out entirely (0 = trace ... 4 = error). The
+// runner build sets it to 2 outside Debug so trace/debug calls cost nothing.
+#ifndef DEFYX_LOG_COMPILED_MIN_LEVEL
+#define DEFYX_LOG_COMPILED_MIN_LEVEL 0
+#endif
+
+namespace defyx_log {
+
+enum class Level : uint8_t {
+  kTrace = 0,
+  kDebug = 1,
+  kInfo = 2,
+  kWarn = 3,
+  kError = 4,
+};
+
+constexpr Level kCompiledMinLevel = static_cast<Level>(DEFYX_LOG_COMPILED_MIN_LEVEL);
+
+// Runtime threshold; defaults to info and can be overridden with the
+// DEFYX_LOG_LEVEL environment variable (trace|debug|info|warn|error).
+inline std::atomic<uint8_t> g_runtime_level{static_cast<uint8_t>(Level::kInfo)};
+
+inline void SetLevel(Level level) {
+  g_runtime_level.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+inline bool IsEnabled(Level level) {
+  return level >= kCompiledMinLevel &&
+         static_cast<uint8_t>(level) >= g_runtime_level.load(std::memory_order_relaxed);
+}
+
+// Queues a line for the native log file. Never blocks the calling thread: the
+// line is copied into a fixed-size lock-free ring and written out in batches by
+// a background flusher thread. When the ring is full the line is dropped and
+// counted instead.
+void Write(Level level, const std::string& msg);
+
+// Path of the active log file, $XDG_STATE_HOME/defyx/defyx_linux.log unless
+// that is not writable. The file is rotated at a size cap and older segments
+// are kept gzip-compressed next to it.
+std::string LogFilePath();
+
+struct Entry {
+  uint64_t seq = 0;
+  int64_t timestamp_ms = 0;
+  Level level = Level::kInfo;
+  std::string text;
+};
+
+// Returns up to |max_count| of the most recent in-memory entries (oldest first)
+// with a sequence number above |since_seq| and a level of at least |min_level|.
+// Sequence numbers are monotonic; only the last few thousand entries are kept,
+// so a caller that falls behind resumes at the oldest one still available.
+// |latest_seq| receives the newest sequence number assigned so far.
+std::vector<Entry> Tail(uint64_t since_seq, size_t max_count, Level min_level,
+                        uint64_t* latest_seq);
+
+// Number of lines dropped because the ring was full.
+uint64_t DroppedCount();
+
+// Drains the ring, stops the flusher thread and switches to direct writes for
+// anything logged afterwards (e.g. from atexit handlers).
+void Shutdown();
+
+// Wraps a potentially large argument (flowlines, decoded JSON) so it is logged
+// as its size and hash rather than copied into the log.
+struct Payload {
+  std::string_view data;
+};
+
+namespace internal {
+
+uint64_t HashBytes(std::string_view data);
+
+inline void Append(std::string* out, std::string_view value) { out->append(value); }
+inline void Append(std::string* out, const char* value) { out->append(value ? value : "(null)"); }
+inline void Append(std::string* out, const std::string& value) { out->append(value); }
+inline void Append(std::string* out, bool value) { out->append(value ? "true" : "false"); }
+void Append(std::string* out, Payload value);
+
+template <typename T,
+          typename = std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>>
+inline void Append(std::string* out, T value) {
+  out->append(std::to_string(value));
+}
+
+}  // namespace internal
+
+// Formats and queues a message only if |L| passes both the compile-time and the
+// runtime threshold; otherwise the arguments are never stringified.
+template <Level L, typename... Args>
+inline void Log(const Args&... args) {
+  if constexpr (L >= kCompiledMinLevel) {
+    if (!IsEnabled(L)) return;
+    std::string line;
+    (internal::Append(&line, args), ...);
+    Write(L, line);
+  }
+}
+
+template <typename... Args>
+inline void Trace(const Args&... args) { Log<Level::kTrace>(args...); }
+template <typename... Args>
+inline void Debug(const Args&... args) { Log<Level::kDebug>(args...); }
+template <typename... Args>
+inline void Info(const Args&... args) { Log<Level::kInfo>(args...); }
+template <typename... Args>
+inline void Warn(const Args&... args) { Log<Level::kWarn>(args...); }
+template <typename... Args>
+inline void Error(const Args&... args) { Log<Level::kError>(args...); }
+
+}  // namespace defyx_log
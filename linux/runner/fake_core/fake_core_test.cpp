@@ -0,0 +1,121 @@
+// Offline regression test for the native core layer: loads the fake
+// libDXcore.so through defyx_core, checks progress delivery, then reloads a
+// copy of it and checks the reload guards and that progress still arrives.
+//
+// Usage: defyx_fake_core_test <path to fake libDXcore.so>
+
+#include "defyx_core.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr auto kProgressTimeout = std::chrono::seconds(5);
+
+std::mutex g_mutex;
+std::condition_variable g_cv;
+std::vector<std::string> g_lines;
+int g_failures = 0;
+
+void Check(bool ok, const std::string& what) {
+  std::printf("%s: %s\n", ok ? "ok" : "FAIL", what.c_str());
+  if (!ok) ++g_failures;
+}
+
+// Waits for |line| to arrive and drops everything delivered up to it.
+bool WaitForLine(const std::string& line) {
+  std::unique_lock<std::mutex> lock(g_mutex);
+  auto deadline = std::chrono::steady_clock::now() + kProgressTimeout;
+  for (;;) {
+    for (size_t i = 0; i < g_lines.size(); ++i) {
+      if (g_lines[i] == line) {
+        g_lines.erase(g_lines.begin(), g_lines.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+        return true;
+      }
+    }
+    if (g_cv.wait_until(lock, deadline) == std::cv_status::timeout) return false;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::fprintf(stderr, "usage: %s <libDXcore.so>\n", argv[0]);
+    return 2;
+  }
+  namespace fs = std::filesystem;
+
+  // Keep the logger, caches and remembered core path out of the user's dirs.
+  fs::path dir = fs::temp_directory_path() / ("defyx_fake_core_test." + std::to_string(::getpid()));
+  fs::create_directories(dir);
+  setenv("XDG_STATE_HOME", (dir / "state").c_str(), 1);
+  setenv("XDG_CACHE_HOME", (dir / "cache").c_str(), 1);
+
+  fs::path config = dir / "fake_core.conf";
+  {
+    std::ofstream out(config);
+    out << "seed = 1\n"
+        << "StartVPN.latency = fixed:10\n"
+        << "StartVPN.progress = 10 Data: VPN connecting\n"
+        << "StartVPN.progress = 10 Data: VPN connected\n"
+        << "StopVPN.latency = fixed:10\n"
+        << "StopVPN.progress = 10 Data: VPN stopped\n";
+  }
+  setenv("DEFYX_FAKE_CORE_CONFIG", config.c_str(), 1);
+
+  defyx_core::RegisterProgressHandler([](std::string line) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_lines.push_back(std::move(line));
+    g_cv.notify_all();
+  });
+
+  Check(defyx_core::LoadCoreDll(argv[1]), "load");
+  Check(!defyx_core::CoreVersion().empty(), "core version");
+
+  Check(defyx_core::StartVPN("", "", ""), "start");
+  Check(WaitForLine("Data: VPN connected"), "connected progress");
+  Check(defyx_core::IsTunnelRunning(), "tunnel running");
+
+  // A second file name, since dlopen hands back the existing mapping for the
+  // same path.
+  fs::path copy = dir / "libDXcore-reload.so";
+  fs::copy_file(argv[1], copy, fs::copy_options::overwrite_existing);
+
+  std::string error;
+  bool reloaded = defyx_core::ReloadCoreDll(copy.string(), &error);
+  Check(!reloaded && error == "TUNNEL_ACTIVE", "reload refused under a tunnel (" + error + ")");
+
+  Check(defyx_core::StopVPN(), "stop");
+  Check(WaitForLine("Data: VPN stopped"), "stopped progress");
+
+  error.clear();
+  reloaded = defyx_core::ReloadCoreDll(copy.string(), &error);
+  Check(reloaded, "reload (" + error + ")");
+  error.clear();
+  reloaded = defyx_core::ReloadCoreDll(copy.string(), &error);
+  Check(!reloaded && error == "ALREADY_LOADED", "reload of the loaded core skipped (" + error + ")");
+
+  // The progress callback has to follow the switch to the new library.
+  Check(defyx_core::StartVPN("", "", ""), "start after reload");
+  Check(WaitForLine("Data: VPN connected"), "connected progress after reload");
+  Check(defyx_core::StopVPN(), "stop after reload");
+  Check(WaitForLine("Data: VPN stopped"), "stopped progress after reload");
+
+  defyx_core::UnloadCoreDll();
+  std::error_code ec;
+  fs::remove_all(dir, ec);
+
+  std::printf("%d failure(s)\n", g_failures);
+  return g_failures == 0 ? 0 : 1;
+}
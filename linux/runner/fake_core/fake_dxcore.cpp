@@ -0,0 +1,458 @@
+// Stand-in for libDXcore.so that exports the same C ABI as the Go core, for
+// exercising and benchmarking the native runner without DXcore-private.
+//
+// Behaviour is read once, on the first call, from the file named by the
+// DEFYX_FAKE_CORE_CONFIG environment variable (see fake_core.conf.example).
+// Without a config every export answers immediately with a plausible value,
+// and StartVPN/StopVPN send the core's own "Data: VPN ..." state lines.
+//
+// Config lines are `key = value`; `#` starts a comment.
+//   seed = <n>                       RNG seed (default: random)
+//   <Export>.latency = <dist>        delay before the export returns
+//   <Export>.fail_rate = <0..1>      probability of a failure result
+//   <Export>.value = <string>        result of string exports
+//   MeasurePing.value = <dist>       ping result in ms
+//   <Export>.progress = <ms> <text>  progress message sent <ms> after the
+//                                    previous one; repeat the key for more.
+//                                    Only StartVPN and StopVPN emit progress.
+//                                    The runner only acts on the core's
+//                                    "Data: VPN connected" style lines.
+//
+// <dist> is one of fixed:<ms>, uniform:<min>:<max>, normal:<mean>:<stddev>
+// or exp:<mean>, all in milliseconds and clamped at zero.
+//
+// A failure makes StartVPN/StopVPN return 0, MeasurePing return -1 and the
+// string exports return NULL; void exports only apply their latency.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Distribution {
+  enum class Kind { kFixed, kUniform, kNormal, kExponential };
+  Kind kind = Kind::kFixed;
+  double a = 0;
+  double b = 0;
+};
+
+struct ProgressStep {
+  int delay_ms = 0;
+  std::string message;
+};
+
+struct ExportConfig {
+  bool has_latency = false;
+  Distribution latency;
+  double fail_rate = 0;
+  bool has_value = false;
+  std::string value;
+  std::vector<ProgressStep> progress;
+};
+
+std::string Trim(const std::string& s) {
+  size_t start = s.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos) return "";
+  size_t end = s.find_last_not_of(" \t\r\n");
+  return s.substr(start, end - start + 1);
+}
+
+bool ParseDistribution(const std::string& text, Distribution* out) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (true) {
+    size_t colon = text.find(':', start);
+    parts.push_back(Trim(text.substr(start, colon - start)));
+    if (colon == std::string::npos) break;
+    start = colon + 1;
+  }
+
+  auto number = [](const std::string& s, double* v) {
+    char* end = nullptr;
+    *v = std::strtod(s.c_str(), &end);
+    return !s.empty() && end && *end == '\0';
+  };
+
+  Distribution d;
+  if (parts.size() == 1 && number(parts[0], &d.a)) {
+    d.kind = Distribution::Kind::kFixed;
+  } else if (parts.size() == 2 && parts[0] == "fixed" && number(parts[1], &d.a)) {
+    d.kind = Distribution::Kind::kFixed;
+  } else if (parts.size() == 2 && parts[0] == "exp" && number(parts[1], &d.a) && d.a > 0) {
+    d.kind = Distribution::Kind::kExponential;
+  } else if (parts.size() == 3 && parts[0] == "uniform" && number(parts[1], &d.a) &&
+             number(parts[2], &d.b) && d.a <= d.b) {
+    d.kind = Distribution::Kind::kUniform;
+  } else if (parts.size() == 3 && parts[0] == "normal" && number(parts[1], &d.a) &&
+             number(parts[2], &d.b) && d.b >= 0) {
+    d.kind = Distribution::Kind::kNormal;
+  } else {
+    return false;
+  }
+  *out = d;
+  return true;
+}
+
+class FakeCore {
+ public:
+  static FakeCore& Get() {
+    static FakeCore core;
+    return core;
+  }
+
+  ~FakeCore() { CancelProgress(); }
+
+  // Sleeps for the export's configured latency and reports whether this call
+  // should fail.
+  bool Enter(const char* name) {
+    const ExportConfig* cfg = Find(name);
+    if (!cfg) return false;
+    if (cfg->has_latency) {
+      std::this_thread::sleep_for(std::chrono::microseconds(
+          static_cast<int64_t>(Sample(cfg->latency) * 1000.0)));
+    }
+    if (cfg->fail_rate <= 0) return false;
+    std::lock_guard<std::mutex> lock(rng_mutex_);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < cfg->fail_rate;
+  }
+
+  std::string Value(const char* name, const std::string& fallback) const {
+    const ExportConfig* cfg = Find(name);
+    return cfg && cfg->has_value ? cfg->value : fallback;
+  }
+
+  long long Ping() {
+    const ExportConfig* cfg = Find("MeasurePing");
+    Distribution d;
+    if (!cfg || !cfg->has_value || !ParseDistribution(cfg->value, &d)) {
+      d.kind = Distribution::Kind::kNormal;
+      d.a = 120;
+      d.b = 25;
+    }
+    return std::max<long long>(1, static_cast<long long>(Sample(d)));
+  }
+
+  void Log(const char* fmt, const char* arg) {
+    if (verbose_.load(std::memory_order_relaxed)) {
+      std::fprintf(stderr, "[fake_dxcore] ");
+      std::fprintf(stderr, fmt, arg);
+      std::fprintf(stderr, "\n");
+    }
+  }
+
+  void SetVerbose(bool enable) { verbose_.store(enable, std::memory_order_relaxed); }
+
+  void SetCallback(void (*cb)(char*)) {
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    callback_ = cb;
+  }
+
+  // Plays the progress script of export |name|, or |fallback| if it has none
+  // (or |name| is null), on a background thread, replacing any script still running. The status
+  // becomes |final_status| once the script has finished.
+  void PlayProgress(const char* name, std::string final_status, std::vector<ProgressStep> fallback) {
+    CancelProgress();
+    const ExportConfig* cfg = name ? Find(name) : nullptr;
+    std::vector<ProgressStep> steps = cfg && !cfg->progress.empty() ? cfg->progress : std::move(fallback);
+
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    cancel_ = false;
+    progress_thread_ = std::thread([this, steps = std::move(steps),
+                                    final_status = std::move(final_status)]() {
+      std::unique_lock<std::mutex> lock(progress_mutex_);
+      for (const auto& step : steps) {
+        if (progress_cv_.wait_for(lock, std::chrono::milliseconds(step.delay_ms),
+                                  [this] { return cancel_; })) {
+          return;
+        }
+        if (auto cb = callback_) {
+          // The runner may call back into the core from the callback.
+          lock.unlock();
+          std::vector<char> buffer(step.message.begin(), step.message.end());
+          buffer.push_back('\0');
+          cb(buffer.data());
+          lock.lock();
+          if (cancel_) return;
+        }
+      }
+      status_ = final_status;
+    });
+  }
+
+  void CancelProgress() {
+    std::thread worker;
+    {
+      std::lock_guard<std::mutex> lock(progress_mutex_);
+      cancel_ = true;
+      worker = std::move(progress_thread_);
+    }
+    progress_cv_.notify_all();
+    if (!worker.joinable()) return;
+    // Stop/StopVPN called from inside a progress callback.
+    if (worker.get_id() == std::this_thread::get_id()) {
+      worker.detach();
+    } else {
+      worker.join();
+    }
+  }
+
+  void SetStatus(const std::string& status) {
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    status_ = status;
+  }
+
+  std::string Status() {
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    return status_;
+  }
+
+  std::atomic<bool> tunnel_running{false};
+
+ private:
+  FakeCore() {
+    const char* path = std::getenv("DEFYX_FAKE_CORE_CONFIG");
+    uint64_t seed = std::random_device{}();
+    if (path && *path) LoadConfig(path, &seed);
+    rng_.seed(seed);
+  }
+
+  void LoadConfig(const char* path, uint64_t* seed) {
+    std::ifstream in(path);
+    if (!in) {
+      std::fprintf(stderr, "[fake_dxcore] cannot open config %s\n", path);
+      return;
+    }
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+      ++line_no;
+      size_t hash = line.find('#');
+      if (hash != std::string::npos) line.erase(hash);
+      line = Trim(line);
+      if (line.empty()) continue;
+
+      size_t eq = line.find('=');
+      if (eq == std::string::npos) {
+        std::fprintf(stderr, "[fake_dxcore] %s:%d: expected key = value\n", path, line_no);
+        continue;
+      }
+      std::string key = Trim(line.substr(0, eq));
+      std::string value = Trim(line.substr(eq + 1));
+
+      if (key == "seed") {
+        *seed = std::strtoull(value.c_str(), nullptr, 10);
+        continue;
+      }
+
+      size_t dot = key.find('.');
+      if (dot == std::string::npos) {
+        std::fprintf(stderr, "[fake_dxcore] %s:%d: unknown key %s\n", path, line_no, key.c_str());
+        continue;
+      }
+      ExportConfig& cfg = exports_[key.substr(0, dot)];
+      std::string field = key.substr(dot + 1);
+
+      bool ok = true;
+      if (field == "latency") {
+        ok = ParseDistribution(value, &cfg.latency);
+        cfg.has_latency = ok;
+      } else if (field == "fail_rate") {
+        cfg.fail_rate = std::clamp(std::strtod(value.c_str(), nullptr), 0.0, 1.0);
+      } else if (field == "value") {
+        cfg.value = value;
+        cfg.has_value = true;
+      } else if (field == "progress") {
+        size_t space = value.find_first_of(" \t");
+        ProgressStep step;
+        step.delay_ms = std::max(0, std::atoi(value.substr(0, space).c_str()));
+        step.message = space == std::string::npos ? "" : Trim(value.substr(space));
+        cfg.progress.push_back(std::move(step));
+      } else {
+        ok = false;
+      }
+      if (!ok) {
+        std::fprintf(stderr, "[fake_dxcore] %s:%d: invalid %s\n", path, line_no, key.c_str());
+      }
+    }
+  }
+
+  const ExportConfig* Find(const char* name) const {
+    auto it = exports_.find(name);
+    return it == exports_.end() ? nullptr : &it->second;
+  }
+
+  double Sample(const Distribution& d) {
+    std::lock_guard<std::mutex> lock(rng_mutex_);
+    double v = d.a;
+    switch (d.kind) {
+      case Distribution::Kind::kFixed:
+        break;
+      case Distribution::Kind::kUniform:
+        v = std::uniform_real_distribution<double>(d.a, d.b)(rng_);
+        break;
+      case Distribution::Kind::kNormal:
+        v = std::normal_distribution<double>(d.a, d.b)(rng_);
+        break;
+      case Distribution::Kind::kExponential:
+        v = std::exponential_distribution<double>(1.0 / d.a)(rng_);
+        break;
+    }
+    return std::max(0.0, v);
+  }
+
+  // Written only by the constructor.
+  std::map<std::string, ExportConfig> exports_;
+
+  std::mutex rng_mutex_;
+  std::mt19937_64 rng_;
+
+  std::atomic<bool> verbose_{false};
+
+  std::mutex progress_mutex_;
+  std::condition_variable progress_cv_;
+  std::thread progress_thread_;
+  bool cancel_ = false;
+  void (*callback_)(char*) = nullptr;
+  std::string status_ = "disconnected";
+};
+
+char* Dup(const std::string& s) {
+  return strdup(s.c_str());
+}
+
+}  // namespace
+
+#define DX_EXPORT __attribute__((visibility("default")))
+
+extern "C" {
+
+DX_EXPORT int StartVPN(const char* cacheDir, const char* flowLine, const char* pattern) {
+  (void)cacheDir; (void)flowLine;
+  FakeCore& core = FakeCore::Get();
+  core.Log("StartVPN pattern=%s", pattern ? pattern : "");
+  core.SetStatus("connecting");
+  if (core.Enter("StartVPN")) {
+    core.PlayProgress(nullptr, "disconnected", {{0, "Data: VPN failed"}});
+    return 0;
+  }
+  core.tunnel_running.store(true);
+  core.PlayProgress("StartVPN", "connected", {{0, "Data: VPN connecting"}, {0, "Data: VPN connected"}});
+  return 1;
+}
+
+DX_EXPORT int StopVPN() {
+  FakeCore& core = FakeCore::Get();
+  core.Log("%s", "StopVPN");
+  if (core.Enter("StopVPN")) return 0;
+  core.tunnel_running.store(false);
+  core.PlayProgress("StopVPN", "disconnected", {{0, "Data: VPN stopped"}});
+  return 1;
+}
+
+DX_EXPORT void StartTun2Socks(long long fd, const char* addr) {
+  (void)fd;
+  FakeCore::Get().Log("StartTun2Socks addr=%s", addr ? addr : "");
+  FakeCore::Get().Enter("StartTun2Socks");
+}
+
+DX_EXPORT void StopTun2Socks() {
+  FakeCore::Get().Enter("StopTun2Socks");
+}
+
+DX_EXPORT void Stop() {
+  FakeCore& core = FakeCore::Get();
+  core.Enter("Stop");
+  core.CancelProgress();
+  core.tunnel_running.store(false);
+  core.SetStatus("disconnected");
+}
+
+DX_EXPORT long long MeasurePing() {
+  FakeCore& core = FakeCore::Get();
+  if (core.Enter("MeasurePing")) return -1;
+  return core.Ping();
+}
+
+DX_EXPORT char* GetFlag() {
+  FakeCore& core = FakeCore::Get();
+  if (core.Enter("GetFlag")) return nullptr;
+  return Dup(core.Value("GetFlag", "de"));
+}
+
+DX_EXPORT void SetAsnName() {
+  FakeCore::Get().Enter("SetAsnName");
+}
+
+DX_EXPORT void SetTimeZone(float tz) {
+  (void)tz;
+  FakeCore::Get().Enter("SetTimeZone");
+}
+
+DX_EXPORT char* GetFlowLine(int isTest) {
+  (void)isTest;
+  FakeCore& core = FakeCore::Get();
+  if (core.Enter("GetFlowLine")) return nullptr;
+  return Dup(core.Value("GetFlowLine", "{}"));
+}
+
+DX_EXPORT char* GetCachedFlowLine() {
+  FakeCore& core = FakeCore::Get();
+  if (core.Enter("GetCachedFlowLine")) return nullptr;
+  return Dup(core.Value("GetCachedFlowLine", ""));
+}
+
+DX_EXPORT char* DecodeAndVerifyFlowline(const char* flowLine) {
+  FakeCore& core = FakeCore::Get();
+  if (core.Enter("DecodeAndVerifyFlowline")) return nullptr;
+  // Echo the input back unless a fixed decoded value is configured.
+  return Dup(core.Value("DecodeAndVerifyFlowline", flowLine ? flowLine : ""));
+}
+
+DX_EXPORT char* GetVpnStatus() {
+  FakeCore& core = FakeCore::Get();
+  if (core.Enter("GetVpnStatus")) return nullptr;
+  return Dup(core.Status());
+}
+
+DX_EXPORT void SetProgressCallback(void (*cb)(char*)) {
+  FakeCore::Get().SetCallback(cb);
+}
+
+DX_EXPORT void SetVerboseLogging(int enable) {
+  FakeCore::Get().SetVerbose(enable != 0);
+}
+
+DX_EXPORT void FreeString(char* s) {
+  std::free(s);
+}
+
+DX_EXPORT void SetConnectionMethod(const char* method) {
+  FakeCore::Get().Log("SetConnectionMethod %s", method ? method : "");
+  FakeCore::Get().Enter("SetConnectionMethod");
+}
+
+DX_EXPORT void SetCacheDir(const char* dir) {
+  FakeCore::Get().Log("SetCacheDir %s", dir ? dir : "");
+  FakeCore::Get().Enter("SetCacheDir");
+}
+
+DX_EXPORT int IsTunnelRunning() {
+  FakeCore& core = FakeCore::Get();
+  core.Enter("IsTunnelRunning");
+  return core.tunnel_running.load() ? 1 : 0;
+}
+
+}  // extern "C"
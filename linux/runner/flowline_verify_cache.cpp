@@ -0,0 +1,278 @@
+#include "defyx_core_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include "defyx_logger.h"
+
+namespace defyx_core {
+namespace {
+
+constexpr uint32_t kFileMagic = 0x56465844;  // "DXFV"
+constexpr uint32_t kFileFormat = 1;
+constexpr const char* kFileName = "verified_flowlines.bin";
+constexpr size_t kMaxEntries = 16;
+// Flowlines are a few KB; anything far bigger is not worth keeping.
+constexpr size_t kMaxEntryBytes = 1 << 20;
+
+// 64-bit multiply-xorshift over 8-byte words. Only has to spread keys: a hit
+// also compares the full input, so a collision can never return the wrong
+// result.
+uint64_t HashBytes(const char* data, size_t size, uint64_t seed = 0x9e3779b97f4a7c15ULL) {
+  constexpr uint64_t kMul = 0xff51afd7ed558ccdULL;
+  uint64_t h = seed ^ (size * kMul);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    h = (h ^ word) * kMul;
+    h ^= h >> 32;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data + i, size - i);
+  h = (h ^ tail) * kMul;
+  h ^= h >> 29;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  return h ^ (h >> 32);
+}
+
+struct Entry {
+  uint64_t hash = 0;
+  std::string input;
+  std::shared_ptr<const std::string> output;
+  uint64_t last_used = 0;
+};
+
+void PutU32(std::string* out, uint32_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutU64(std::string* out, uint64_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutString(std::string* out, const std::string& value) {
+  PutU32(out, static_cast<uint32_t>(value.size()));
+  out->append(value);
+}
+
+class Reader {
+ public:
+  explicit Reader(const std::string& data) : data_(data) {}
+
+  bool U32(uint32_t* value) { return Raw(value, sizeof(*value)); }
+  bool U64(uint64_t* value) { return Raw(value, sizeof(*value)); }
+  bool String(std::string* value) {
+    uint32_t size = 0;
+    if (!U32(&size) || size > kMaxEntryBytes || data_.size() - pos_ < size) return false;
+    value->assign(data_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+ private:
+  bool Raw(void* out, size_t size) {
+    if (data_.size() - pos_ < size) return false;
+    std::memcpy(out, data_.data() + pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  const std::string& data_;
+  size_t pos_ = 0;
+};
+
+// The cache dir used to be world-shared /tmp; never trust a file there that
+// another user could have planted or can still modify.
+bool OwnedAndPrivate(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+// Decoded flowlines that the core has verified, keyed by a hash of the input
+// and persisted in the core's cache dir. Bound to the core build that did the
+// verification: a different CoreVersion drops everything.
+class VerifiedFlowlineCache {
+ public:
+  CoreString Get(const std::string& flowLine) {
+    std::string version = CoreVersion();
+    if (version.empty()) {
+      return DecodeAndVerifyFlowline(flowLine);
+    }
+
+    uint64_t hash = HashBytes(flowLine.data(), flowLine.size());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Sync(version, CacheDir());
+      for (auto& entry : entries_) {
+        if (entry.hash == hash && entry.input == flowLine) {
+          entry.last_used = ++clock_;
+          ++hits_;
+          return CoreString(entry.output);
+        }
+      }
+      ++misses_;
+    }
+
+    CoreString result = DecodeAndVerifyFlowline(flowLine);
+    // Empty means verification failed; never remember that.
+    if (!result.from_core() || result.empty() || flowLine.size() + result.size() > kMaxEntryBytes) {
+      return result;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (version != version_) return result;
+    Entry entry;
+    entry.hash = hash;
+    entry.input = flowLine;
+    entry.output = std::make_shared<const std::string>(result.view());
+    entry.last_used = ++clock_;
+    if (entries_.size() >= kMaxEntries) {
+      auto oldest = entries_.begin();
+      for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->last_used < oldest->last_used) oldest = it;
+      }
+      entries_.erase(oldest);
+    }
+    entries_.push_back(std::move(entry));
+    Save();
+    return result;
+  }
+
+  ResultCacheStats Stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ResultCacheStats stats;
+    stats.name = "decodeAndVerifyFlowline";
+    stats.hits = hits_;
+    stats.misses = misses_;
+    return stats;
+  }
+
+ private:
+  // Re-reads the file when the core build or cache dir changed.
+  void Sync(const std::string& version, const std::string& dir) {
+    if (version == version_ && dir == dir_) return;
+    version_ = version;
+    dir_ = dir;
+    entries_.clear();
+    Load();
+  }
+
+  std::string FilePath() const {
+    return dir_.empty() ? std::string() : dir_ + "/" + kFileName;
+  }
+
+  void Load() {
+    std::string path = FilePath();
+    if (path.empty() || !std::filesystem::exists(path)) return;
+    if (!OwnedAndPrivate(dir_) || !OwnedAndPrivate(path)) {
+      defyx_log::Warn("Verified flowline cache ignored: ", path, " is not private to this user");
+      return;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(uint64_t)) return Discard(path, "truncated");
+
+    size_t body = data.size() - sizeof(uint64_t);
+    uint64_t checksum;
+    std::memcpy(&checksum, data.data() + body, sizeof(checksum));
+    if (checksum != HashBytes(data.data(), body)) return Discard(path, "checksum mismatch");
+
+    Reader reader(data);
+    uint32_t magic = 0, format = 0, count = 0;
+    std::string version;
+    if (!reader.U32(&magic) || magic != kFileMagic || !reader.U32(&format) || format != kFileFormat ||
+        !reader.String(&version) || !reader.U32(&count)) {
+      return Discard(path, "bad header");
+    }
+    if (version != version_) return Discard(path, "written by a different core build");
+
+    std::vector<Entry> entries;
+    for (uint32_t i = 0; i < count && i < kMaxEntries; ++i) {
+      Entry entry;
+      std::string output;
+      if (!reader.U64(&entry.hash) || !reader.String(&entry.input) || !reader.String(&output) ||
+          entry.hash != HashBytes(entry.input.data(), entry.input.size())) {
+        return Discard(path, "bad entry");
+      }
+      entry.output = std::make_shared<const std::string>(std::move(output));
+      entry.last_used = ++clock_;
+      entries.push_back(std::move(entry));
+    }
+    entries_ = std::move(entries);
+    defyx_log::Debug("Verified flowline cache: loaded ", entries_.size(), " entries from ", path);
+  }
+
+  void Discard(const std::string& path, const char* reason) {
+    defyx_log::Info("Verified flowline cache discarded (", reason, "): ", path);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+
+  // Written to a temp file and renamed over the old one, so a crash leaves
+  // either the previous file or the new one.
+  void Save() {
+    std::string path = FilePath();
+    if (path.empty()) return;
+
+    std::string data;
+    PutU32(&data, kFileMagic);
+    PutU32(&data, kFileFormat);
+    PutString(&data, version_);
+    PutU32(&data, static_cast<uint32_t>(entries_.size()));
+    for (const auto& entry : entries_) {
+      PutU64(&data, entry.hash);
+      PutString(&data, entry.input);
+      PutString(&data, *entry.output);
+    }
+    PutU64(&data, HashBytes(data.data(), data.size()));
+
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    bool ok = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    ok = close(fd) == 0 && ok;
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) {
+      std::filesystem::remove(tmp, ec);
+    }
+  }
+
+  std::mutex mutex_;
+  std::string version_;
+  std::string dir_;
+  std::vector<Entry> entries_;
+  uint64_t clock_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+// Leaked on purpose, like the other result caches.
+VerifiedFlowlineCache& Cache() {
+  static auto* cache = new VerifiedFlowlineCache();
+  return *cache;
+}
+
+}  // namespace
+
+CoreString CachedDecodeAndVerifyFlowline(const std::string& flowLine) {
+  return Cache().Get(flowLine);
+}
+
+ResultCacheStats GetVerifiedFlowlineCacheStats() {
+  return Cache().Stats();
+}
+
+}  // namespace defyx_core
@@ -0,0 +1,26 @@
+#include "main_thread.h"
+
+#include <glib.h>
+
+#include <utility>
+
+namespace main_thread {
+namespace {
+
+gboolean RunInvoked(gpointer user_data) {
+  (*static_cast<std::function<void()>*>(user_data))();
+  return G_SOURCE_REMOVE;
+}
+
+void DeleteInvoked(gpointer user_data) {
+  delete static_cast<std::function<void()>*>(user_data);
+}
+
+}  // namespace
+
+void Invoke(std::function<void()> fn) {
+  g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, RunInvoked,
+                             new std::function<void()>(std::move(fn)), DeleteInvoked);
+}
+
+}  // namespace main_thread
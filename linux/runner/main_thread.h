@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <thread>
+
+// Tracks the GTK main thread so blocking work can assert it never runs there,
+// and hands results back to it.
+namespace main_thread {
+
+inline std::atomic<std::thread::id> g_main_thread_id{};
+
+// Called at activate; until then (and after Clear at shutdown) no thread
+// counts as the main thread.
+inline void Mark() {
+  g_main_thread_id.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+
+inline void Clear() {
+  g_main_thread_id.store(std::thread::id(), std::memory_order_relaxed);
+}
+
+inline bool IsCurrent() {
+  return g_main_thread_id.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+// Queues |fn| to run on the default GLib main context.
+void Invoke(std::function<void()> fn);
+
+}  // namespace main_thread
+
+// Placed at the top of core and proxy calls that can block for network or
+// process round trips. Debug builds abort if one is reached on the main
+// thread; release builds compile it out.
+#ifdef NDEBUG
+#define DEFYX_ASSERT_OFF_MAIN_THREAD(what) ((void)0)
+#else
+#define DEFYX_ASSERT_OFF_MAIN_THREAD(what) \
+  assert(!main_thread::IsCurrent() && "blocking " what " on the GTK main thread")
+#endif
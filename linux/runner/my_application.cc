@@ -12,7 +12,10 @@
 #include "system_tray.h"
 #include "settings_manager.h"
 #include "vpn_channel_handler.h"
+#include "core_prewarm.h"
 #include "defyx_core.h"
+#include "defyx_logger.h"
+#include "main_thread.h"
 
 // Forward declaration for our custom plugin
 void RegisterDefyxLinuxPlugin(FlPluginRegistrar *registrar);
@@ -284,6 +287,9 @@ static gboolean on_window_delete_event(GtkWidget *widget, GdkEvent *event, gpoin
 static void my_application_activate(GApplication *application)
 {
   MyApplication *self = MY_APPLICATION(application);
+  main_thread::Mark();
+  // Core load, cache dir and the cached flowline, off the startup path.
+  defyx_core::StartPrewarm();
   GtkWindow *window =
       GTK_WINDOW(gtk_application_window_new(GTK_APPLICATION(application)));
 
@@ -366,9 +372,6 @@ static void my_application_activate(GApplication *application)
       fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view), "DefyxLinuxPlugin");
   RegisterDefyxLinuxPlugin(defyx_registrar);
 
-  // Load the DXcore library
-  defyx_core::LoadCoreDll("");
-
   // Get messenger for VPN channel handler
   FlBinaryMessenger *messenger = fl_engine_get_binary_messenger(fl_view_get_engine(view));
 
@@ -496,6 +499,9 @@ static void my_application_shutdown(GApplication *application)
 {
   // MyApplication* self = MY_APPLICATION(object);
 
+  // The loop has stopped; the atexit proxy reset runs on this thread next.
+  main_thread::Clear();
+
   // Cleanup global instances
   if (g_vpn_channel_handler)
   {
@@ -519,6 +525,9 @@ static void my_application_shutdown(GApplication *application)
   // Unload the DXcore library
   defyx_core::UnloadCoreDll();
 
+  // Flush queued log lines; later writes (atexit handlers) go straight to disk
+  defyx_log::Shutdown();
+
   g_main_window = nullptr;
   g_flutter_view = nullptr;
 
@@ -0,0 +1,80 @@
+#include "native_executor.h"
+
+#include <utility>
+
+#include "defyx_logger.h"
+
+NativeExecutor::NativeExecutor(size_t general_workers, size_t critical_capacity,
+                               size_t background_capacity)
+    : critical_capacity_(critical_capacity), background_capacity_(background_capacity) {
+  workers_.emplace_back(&NativeExecutor::Run, this, true);
+  for (size_t i = 0; i < general_workers; ++i) {
+    workers_.emplace_back(&NativeExecutor::Run, this, false);
+  }
+}
+
+NativeExecutor::~NativeExecutor() {
+  Shutdown();
+}
+
+bool NativeExecutor::Post(Lane lane, std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) return false;
+    auto& queue = lane == Lane::kCritical ? critical_ : background_;
+    size_t capacity = lane == Lane::kCritical ? critical_capacity_ : background_capacity_;
+    if (queue.size() >= capacity) {
+      defyx_log::Warn("NativeExecutor ", lane == Lane::kCritical ? "critical" : "background",
+                      " lane full (", capacity, "); rejecting task");
+      return false;
+    }
+    queue.push_back(std::move(task));
+  }
+  // Critical-only workers ignore background posts, so wake everyone.
+  cv_.notify_all();
+  return true;
+}
+
+void NativeExecutor::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ && workers_.empty()) return;
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) {
+    if (worker.joinable()) worker.join();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  workers_.clear();
+}
+
+void NativeExecutor::Run(bool critical_only) {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [&] {
+        return stopping_ || !critical_.empty() || (!critical_only && !background_.empty());
+      });
+      if (!critical_.empty()) {
+        task = std::move(critical_.front());
+        critical_.pop_front();
+      } else if (!critical_only && !background_.empty()) {
+        task = std::move(background_.front());
+        background_.pop_front();
+      } else {
+        // Stopping and nothing left that this worker may run.
+        return;
+      }
+    }
+
+    try {
+      task();
+    } catch (const std::exception& e) {
+      defyx_log::Error("NativeExecutor task threw: ", e.what());
+    } catch (...) {
+      defyx_log::Error("NativeExecutor task threw an unknown exception");
+    }
+  }
+}
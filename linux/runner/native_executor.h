@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed pool for blocking native work (core calls, proxy changes) that
+// must stay off the GTK main thread. Work is queued on one of two bounded
+// lanes. One worker only ever runs critical work, so a stop or disconnect
+// never waits behind a stuck ping; the others take critical work first and
+// background work otherwise.
+class NativeExecutor {
+ public:
+  enum class Lane {
+    kCritical,    // user-initiated: connect, disconnect, proxy changes
+    kBackground,  // opportunistic: ping, flag, lookups
+  };
+
+  NativeExecutor(size_t general_workers, size_t critical_capacity, size_t background_capacity);
+  ~NativeExecutor();
+
+  NativeExecutor(const NativeExecutor&) = delete;
+  NativeExecutor& operator=(const NativeExecutor&) = delete;
+
+  // Queues |task|. Returns false without running it if the lane is full or
+  // the executor is shutting down; the caller must then complete the work
+  // itself (usually by answering with a default).
+  bool Post(Lane lane, std::function<void()> task);
+
+  // Stops accepting work, runs everything already queued and joins the
+  // workers. Called by the destructor; safe to call more than once.
+  void Shutdown();
+
+ private:
+  void Run(bool critical_only);
+
+  const size_t critical_capacity_;
+  const size_t background_capacity_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> critical_;
+  std::deque<std::function<void()>> background_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
@@ -0,0 +1,133 @@
+#include "progress_pipeline.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+struct ProgressPipeline::Source {
+  GSource base;
+  ProgressPipeline* owner;
+  gpointer fd_tag;
+};
+
+ProgressPipeline::ProgressPipeline(BatchHandler handler, gint64 interval_us)
+    : handler_(std::move(handler)), interval_us_(interval_us) {
+  static GSourceFuncs funcs = {
+      nullptr,  // prepare: woken only by the eventfd or the ready time
+      nullptr,  // check
+      &ProgressPipeline::Dispatch,
+      nullptr,  // finalize
+      nullptr,
+      nullptr,
+  };
+  event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  source_ = reinterpret_cast<Source*>(g_source_new(&funcs, sizeof(Source)));
+  source_->owner = this;
+  source_->fd_tag = event_fd_ >= 0
+                        ? g_source_add_unix_fd(&source_->base, event_fd_, static_cast<GIOCondition>(G_IO_IN))
+                        : nullptr;
+  g_source_set_name(&source_->base, "defyx-progress");
+  g_source_attach(&source_->base, nullptr);
+}
+
+ProgressPipeline::~ProgressPipeline() {
+  g_source_destroy(&source_->base);
+  g_source_unref(&source_->base);
+  if (event_fd_ >= 0) {
+    close(event_fd_);
+  }
+  Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+  while (node != nullptr) {
+    Node* next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
+void ProgressPipeline::Push(std::string message) {
+  Node* node = new Node{std::move(message), nullptr};
+  node->next = head_.load(std::memory_order_relaxed);
+  while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+  pushed_.fetch_add(1, std::memory_order_relaxed);
+
+  if (wake_pending_.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  if (event_fd_ >= 0) {
+    uint64_t one = 1;
+    ssize_t written = write(event_fd_, &one, sizeof(one));
+    (void)written;
+  } else {
+    // No eventfd: fall back to the ready time, which wakes the main context.
+    g_source_set_ready_time(&source_->base, 0);
+  }
+}
+
+ProgressPipeline::Stats ProgressPipeline::GetStats() const {
+  Stats stats;
+  stats.pushed = pushed_.load(std::memory_order_relaxed);
+  stats.delivered = delivered_.load(std::memory_order_relaxed);
+  stats.collapsed = collapsed_.load(std::memory_order_relaxed);
+  stats.batches = batches_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+gboolean ProgressPipeline::Dispatch(GSource* source, GSourceFunc /*callback*/, gpointer /*user_data*/) {
+  auto* self_source = reinterpret_cast<Source*>(source);
+  ProgressPipeline* self = self_source->owner;
+
+  if (self_source->fd_tag != nullptr &&
+      (g_source_query_unix_fd(source, self_source->fd_tag) & G_IO_IN)) {
+    uint64_t count = 0;
+    ssize_t got = read(self->event_fd_, &count, sizeof(count));
+    (void)got;
+  }
+
+  // Hold the flush until a frame interval has passed since the last one;
+  // wake_pending_ stays set meanwhile, so producers don't write the eventfd.
+  gint64 now = g_source_get_time(source);
+  gint64 due = self->last_flush_us_ + self->interval_us_;
+  if (self->last_flush_us_ != 0 && now < due) {
+    g_source_set_ready_time(source, due);
+    return G_SOURCE_CONTINUE;
+  }
+  g_source_set_ready_time(source, -1);
+  self->last_flush_us_ = now;
+  self->Flush();
+  return G_SOURCE_CONTINUE;
+}
+
+void ProgressPipeline::Flush() {
+  // Cleared before taking the queue: a Push that lands after the exchange
+  // below is guaranteed to wake us again.
+  wake_pending_.store(false, std::memory_order_release);
+  Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+  if (node == nullptr) {
+    return;
+  }
+
+  std::vector<std::string> batch;
+  while (node != nullptr) {
+    Node* next = node->next;
+    batch.push_back(std::move(node->message));
+    delete node;
+    node = next;
+  }
+  std::reverse(batch.begin(), batch.end());
+
+  if (batch.size() > kBackpressureThreshold) {
+    size_t before = batch.size();
+    batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+    collapsed_.fetch_add(before - batch.size(), std::memory_order_relaxed);
+  }
+
+  delivered_.fetch_add(batch.size(), std::memory_order_relaxed);
+  batches_.fetch_add(1, std::memory_order_relaxed);
+  if (handler_) {
+    handler_(batch);
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glib.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Carries core progress messages to the GTK main thread in batches. Push is
+// lock-free and safe from any thread (the core calls it from its own); an
+// eventfd wakes one GSource on the default main context, which hands
+// everything queued since the last flush to the batch handler at most once
+// per frame interval. When a batch is large the UI is falling behind, so
+// runs of identical messages are collapsed to one before delivery.
+class ProgressPipeline {
+ public:
+  using BatchHandler = std::function<void(std::vector<std::string>& batch)>;
+
+  struct Stats {
+    uint64_t pushed = 0;     // messages accepted by Push
+    uint64_t delivered = 0;  // messages handed to the batch handler
+    uint64_t collapsed = 0;  // repeats dropped under backpressure
+    uint64_t batches = 0;    // handler invocations (main-loop flushes)
+  };
+
+  static constexpr gint64 kFrameIntervalUs = 16 * 1000;
+  // Batches bigger than this get their repeats collapsed.
+  static constexpr size_t kBackpressureThreshold = 32;
+
+  // Must be created and destroyed on the main thread.
+  explicit ProgressPipeline(BatchHandler handler, gint64 interval_us = kFrameIntervalUs);
+  ~ProgressPipeline();
+
+  ProgressPipeline(const ProgressPipeline&) = delete;
+  ProgressPipeline& operator=(const ProgressPipeline&) = delete;
+
+  void Push(std::string message);
+
+  Stats GetStats() const;
+
+ private:
+  struct Node {
+    std::string message;
+    Node* next = nullptr;
+  };
+  struct Source;
+
+  static gboolean Dispatch(GSource* source, GSourceFunc callback, gpointer user_data);
+
+  void Flush();
+
+  BatchHandler handler_;
+  const gint64 interval_us_;
+  int event_fd_ = -1;
+  Source* source_ = nullptr;
+  gint64 last_flush_us_ = 0;
+
+  // Producers push onto this stack; Flush takes it whole and reverses it.
+  std::atomic<Node*> head_{nullptr};
+  // Set by the first Push after a flush; only that one writes the eventfd.
+  std::atomic<bool> wake_pending_{false};
+
+  std::atomic<uint64_t> pushed_{0};
+  std::atomic<uint64_t> delivered_{0};
+  std::atomic<uint64_t> collapsed_{0};
+  std::atomic<uint64_t> batches_{0};
+};
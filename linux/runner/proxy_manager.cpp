@@ -1,19 +1,26 @@
 #include "proxy_manager.h"
 
+#include "cache_manager.h"
+#include "connect_trace.h"
 #include "defyx_core.h"
+#include "main_thread.h"
+
+#include <gio/gio.h>
 
 #include <algorithm>
 #include <cstdlib>
-#include <cstdio>
 #include <cstring>
 #include <cctype>
+#include <cerrno>
 #include <filesystem>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
-#include <sys/wait.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 // This is customized system proxy manager written by voidreaper. the code set proxy for different linux distro based in De-manager.it supports gnome,xfce,kde... 
 // the QA for the gnome has been tested and fully in production level . for other distros please check and inform me. 
@@ -101,6 +108,8 @@ struct NmConnectionSnapshot {
   std::string http;
   std::string https;
   std::string socks;
+  // Set once a manual proxy is about to be, or has been, written to the
+  // connection; only those are restored.
   bool manual_supported = false;
 };
 
@@ -125,6 +134,14 @@ struct ProxyBackends {
   bool use_nm = false;
 };
 
+struct ProxyCapabilities {
+  std::string fingerprint;
+  // Schemas with "mode" and "http.host", the keys the gsettings backend needs.
+  std::vector<std::string> gsettings_schemas;
+  bool xfconf_available = false;
+  std::string xfce_channel;
+};
+
 struct ApplyResults {
   bool env_applied = false;
   bool gsettings_applied = false;
@@ -140,66 +157,38 @@ Snapshot g_snapshot;
 bool g_applied = false;
 std::string g_snapshot_path;
 
-struct CommandResult {
-  int exit_code = -1;
-  std::string output;
-};
+// GIO builds its default schema source once per process, so it never sees
+// schemas installed after that. Capabilities() swaps in a freshly built source
+// whenever the capability fingerprint changes; until then the default is used.
+GSettingsSchemaSource* g_schema_source = nullptr;
+bool g_schema_source_rebuilt = false;
 
-CommandResult RunCommandInternal(const std::string& command, bool log_on_error) {
-  CommandResult result;
-  FILE* pipe = popen(command.c_str(), "r");
-  if (!pipe) {
-    defyx_core::LogMessage("ProxyManager: failed to run command: " + command);
-    return result;
-  }
-
-  char buffer[256];
-  while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-    result.output.append(buffer);
-  }
-
-  int status = pclose(pipe);
-  if (status == -1) {
-    defyx_core::LogMessage("ProxyManager: failed to close command pipe");
-    result.exit_code = -1;
-    return result;
-  }
-  if (WIFEXITED(status)) {
-    result.exit_code = WEXITSTATUS(status);
-  } else {
-    result.exit_code = status;
-  }
-  if (result.exit_code != 0 && log_on_error) {
-    std::ostringstream oss;
-    oss << "ProxyManager: command exited with code " << result.exit_code << ": " << command;
-    defyx_core::LogMessage(oss.str());
-  }
-  return result;
+GSettingsSchemaSource* SchemaSource() {
+  return g_schema_source_rebuilt ? g_schema_source : g_settings_schema_source_get_default();
 }
 
-CommandResult RunCommand(const std::string& command) {
-  return RunCommandInternal(command, true);
+// GSettings schemas are looked up in GIO's compiled schema cache, in process.
+// Null when no schemas are installed at all.
+bool GsettingsAvailable() {
+  return SchemaSource() != nullptr;
 }
 
-CommandResult RunCommandQuiet(const std::string& command) {
-  return RunCommandInternal(command, false);
-}
-
-bool CommandExists(const std::string& cmd) {
-  CommandResult r = RunCommandQuiet("which " + cmd + " 2>/dev/null");
-  return r.exit_code == 0 && !r.output.empty();
+// |id| among the installed schemas, or null. Relocatable schemas have no fixed
+// path and can't be opened without one, so they count as missing.
+GSettingsSchema* LookupGsettingsSchema(const std::string& id) {
+  GSettingsSchemaSource* source = SchemaSource();
+  if (!source || id.empty()) return nullptr;
+  GSettingsSchema* schema = g_settings_schema_source_lookup(source, id.c_str(), TRUE);
+  if (schema && !g_settings_schema_get_path(schema)) {
+    g_settings_schema_unref(schema);
+    return nullptr;
+  }
+  return schema;
 }
 
 bool GSettingsKeyExists(const std::string& schema, const std::string& key) {
-  if (!CommandExists("gsettings")) return false;
-  std::string range_cmd = "gsettings range " + schema + " " + key + " >/dev/null 2>&1";
-  CommandResult range_result = RunCommandQuiet(range_cmd);
-  if (range_result.exit_code == 0) {
-    return true;
-  }
-  std::string get_cmd = "gsettings get " + schema + " " + key + " >/dev/null 2>&1";
-  CommandResult get_result = RunCommandQuiet(get_cmd);
-  return get_result.exit_code == 0;
+  g_autoptr(GSettingsSchema) found = LookupGsettingsSchema(schema);
+  return found && g_settings_schema_has_key(found, key.c_str());
 }
 
 std::string Escape(const std::string& value) {
@@ -352,8 +341,10 @@ std::string JoinStrings(const std::vector<std::string>& items, char delimiter) {
   return oss.str();
 }
 
-// Forward declaration for helpers that require shell quoting but are defined later.
-std::string QuoteForShell(const std::string& value);
+// Forward declarations for probes defined with their backends below.
+bool NetworkManagerRunning();
+bool KdeConfigDetected();
+ProxyCapabilities& Capabilities();
 
 std::vector<std::string> SplitString(const std::string& input, char delimiter) {
   std::vector<std::string> parts;
@@ -368,19 +359,6 @@ std::vector<std::string> SplitString(const std::string& input, char delimiter) {
   return parts;
 }
 
-std::vector<std::string> ParseXfconfList(const std::string& input) {
-  std::vector<std::string> values;
-  std::stringstream ss(input);
-  std::string line;
-  while (std::getline(ss, line)) {
-    std::string trimmed = TrimWhitespace(line);
-    if (!trimmed.empty()) {
-      values.push_back(trimmed);
-    }
-  }
-  return values;
-}
-
 std::vector<std::string> BuildNoProxyList(const std::string& extra) {
   std::vector<std::string> defaults = {"localhost", "127.0.0.1", "::1"};
   std::vector<std::string> extra_parts = SplitString(extra, ',');
@@ -441,7 +419,7 @@ bool NormalizeGsettingsValueForSet(const std::string& raw, std::string* out) {
 ProxyBackends DetermineProxyBackends() {
   ProxyBackends backends;
   backends.use_env = true;
-  backends.use_nm = CommandExists("nmcli");
+  backends.use_nm = NetworkManagerRunning();
 
   auto tokens = DesktopTokens();
   bool gsettings_hint = false;
@@ -465,25 +443,25 @@ ProxyBackends DetermineProxyBackends() {
     }
   }
 
-  if (gsettings_hint && CommandExists("gsettings")) {
+  if (gsettings_hint && GsettingsAvailable()) {
     backends.use_gsettings = true;
   }
 
-  if (kde_hint && CommandExists("kwriteconfig5")) {
+  if (kde_hint && KdeConfigDetected()) {
     backends.use_kde = true;
   }
 
-  if (xfce_hint && CommandExists("xfconf-query")) {
+  if (xfce_hint && Capabilities().xfconf_available) {
     backends.use_xfconf = true;
   }
 
-  if (!gsettings_hint && !backends.use_gsettings && CommandExists("gsettings")) {
+  if (!gsettings_hint && !backends.use_gsettings && GsettingsAvailable()) {
     // Fallback to gsettings when available, since many desktop environments rely on it.
     backends.use_gsettings = true;
   }
 
-  if (!kde_hint && !backends.use_kde && CommandExists("kwriteconfig5")) {
-    // If kwriteconfig5 exists but KDE wasn't hinted, prefer not to change KDE settings implicitly.
+  if (!kde_hint && !backends.use_kde && KdeConfigDetected()) {
+    // If kioslaverc exists but KDE wasn't hinted, prefer not to change KDE settings implicitly.
     backends.use_kde = false;
   }
 
@@ -514,7 +492,7 @@ GsettingsSnapshot* EnsureGsettingsSnapshot(const std::string& schema) {
   return &g_snapshot.gsettings.back();
 }
 
-std::vector<std::string> CandidateGsettingsSchemas() {
+const std::vector<std::string>& KnownGsettingsSchemas() {
   static const std::vector<std::string> kCandidates = {
       "org.gnome.system.proxy",
       "org.gnome.desktop.proxy",
@@ -530,7 +508,11 @@ std::vector<std::string> CandidateGsettingsSchemas() {
       "org.ukui.proxy",
       "org.lxqt.proxy"
   };
+  return kCandidates;
+}
 
+std::vector<std::string> CandidateGsettingsSchemas() {
+  const auto& kCandidates = KnownGsettingsSchemas();
   std::vector<std::string> result;
   result.reserve(kCandidates.size() + g_snapshot.gsettings.size());
 
@@ -594,98 +576,283 @@ const std::vector<std::string>& CandidateXfceChannels() {
   return kChannels;
 }
 
-bool XfconfPropertyExists(const std::string& channel, const std::string& property) {
-  if (channel.empty()) return false;
-  std::string command = "xfconf-query -c " + channel + " -p " + property + " 2>/dev/null";
-  CommandResult res = RunCommandQuiet(command);
-  return res.exit_code == 0;
+// Asked of the bus daemon itself, so they work whether or not the service runs.
+constexpr int kBusProbeTimeoutMs = 1000;
+
+bool DBusNameHasOwner(GDBusConnection* bus, const char* name) {
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_sync(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                  "NameHasOwner", g_variant_new("(s)", name), G_VARIANT_TYPE("(b)"),
+                                  G_DBUS_CALL_FLAGS_NONE, kBusProbeTimeoutMs, nullptr, nullptr);
+  if (!reply) return false;
+  gboolean has_owner = FALSE;
+  g_variant_get(reply, "(b)", &has_owner);
+  return has_owner;
 }
 
-bool XfconfReadProperty(const std::string& channel, const std::string& property, std::string* value) {
-  if (channel.empty()) return false;
-  std::string command = "xfconf-query -c " + channel + " -p " + property + " 2>/dev/null";
-  CommandResult res = RunCommandQuiet(command);
-  if (res.exit_code != 0) {
-    return false;
-  }
-  if (value) {
-    *value = TrimWhitespace(res.output);
-  }
-  return true;
+bool DBusNameActivatable(GDBusConnection* bus, const char* name) {
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_sync(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                  "ListActivatableNames", nullptr, G_VARIANT_TYPE("(as)"),
+                                  G_DBUS_CALL_FLAGS_NONE, kBusProbeTimeoutMs, nullptr, nullptr);
+  if (!reply) return false;
+  g_autoptr(GVariant) names = g_variant_get_child_value(reply, 0);
+  for (gsize i = 0; i < g_variant_n_children(names); ++i) {
+    g_autoptr(GVariant) entry = g_variant_get_child_value(names, i);
+    if (std::strcmp(g_variant_get_string(entry, nullptr), name) == 0) return true;
+  }
+  return false;
 }
 
-void XfconfResetProperty(const std::string& channel, const std::string& property) {
-  if (channel.empty()) return;
-  std::string command = "xfconf-query -c " + channel + " -p " + property + " -r 2>/dev/null";
-  RunCommandQuiet(command);
+// Xfconf over D-Bus, served by xfconfd. A channel's proxy keys are read with a
+// single GetAllProperties; writes are pipelined through XfconfBatch.
+constexpr const char* kXfconfService = "org.xfce.Xfconf";
+constexpr const char* kXfconfPath = "/org/xfce/Xfconf";
+constexpr const char* kXfconfInterface = "org.xfce.Xfconf";
+constexpr const char* kXfconfProxyBase = "/general";
+constexpr int kXfconfCallTimeoutMs = 3000;
+
+GDBusConnection* XfconfSessionBus() {
+  GError* error = nullptr;
+  GDBusConnection* bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+  if (!bus) {
+    defyx_core::LogMessage(std::string("ProxyManager: session bus unavailable: ") + error->message);
+    g_error_free(error);
+  }
+  return bus;
 }
 
-bool XfconfSetValue(const std::string& channel,
-                    const std::string& property,
-                    const std::string& type,
-                    const std::string& value) {
-  if (channel.empty()) return false;
-  std::string base = "xfconf-query -c " + channel + " -p " + property + " -s " + QuoteForShell(value) + " 2>/dev/null";
-  CommandResult res = RunCommandQuiet(base);
-  if (res.exit_code == 0) {
-    return true;
-  }
-  std::string create = "xfconf-query -c " + channel + " -p " + property + " -n -t " + type + " -s " + QuoteForShell(value) + " 2>/dev/null";
-  res = RunCommandQuiet(create);
-  if (res.exit_code != 0) {
-    std::ostringstream oss;
-    oss << "ProxyManager: failed to set XFCE property " << property << " (type=" << type << ")";
-    defyx_core::LogMessage(oss.str());
+// xfconfd is bus-activated, so it counts as available before anything has
+// started it; that matches what having xfconf-query installed used to mean.
+bool XfconfAvailable() {
+  GError* error = nullptr;
+  g_autoptr(GDBusConnection) bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+  if (!bus) {
+    g_clear_error(&error);
     return false;
   }
-  return true;
+  return DBusNameHasOwner(bus, kXfconfService) || DBusNameActivatable(bus, kXfconfService);
 }
 
-bool XfconfSetStringList(const std::string& channel,
-                         const std::string& property,
-                         const std::vector<std::string>& values) {
-  if (channel.empty()) return false;
-  XfconfResetProperty(channel, property);
-  if (values.empty()) {
-    return true;
+// Returns the reply, or null with |error| set.
+GVariant* XfconfCall(GDBusConnection* bus,
+                     const char* method,
+                     GVariant* parameters,
+                     const GVariantType* reply_type,
+                     GError** error) {
+  return g_dbus_connection_call_sync(bus, kXfconfService, kXfconfPath, kXfconfInterface, method, parameters,
+                                     reply_type, G_DBUS_CALL_FLAGS_NONE, kXfconfCallTimeoutMs, nullptr, error);
+}
+
+// Errors xfconfd raises itself (no such channel, no such property) as opposed
+// to the call not getting through. With |code|, only that one, e.g.
+// "PropertyNotFound".
+bool IsXfconfError(const GError* error, const char* code = nullptr) {
+  g_autofree gchar* name = g_dbus_error_get_remote_error(error);
+  if (!name || std::strncmp(name, "org.xfce.Xfconf.Error.", 22) != 0) return false;
+  return !code || std::strcmp(name + 22, code) == 0;
+}
+
+bool XfconfPropertyExists(GDBusConnection* bus, const std::string& channel, const std::string& property) {
+  g_autoptr(GVariant) reply = XfconfCall(bus, "PropertyExists", g_variant_new("(ss)", channel.c_str(), property.c_str()),
+                                         G_VARIANT_TYPE("(b)"), nullptr);
+  if (!reply) return false;
+  gboolean exists = FALSE;
+  g_variant_get(reply, "(b)", &exists);
+  return exists;
+}
+
+// Property values as xfconf-query prints them, which is what snapshots hold.
+std::string XfconfValueToText(GVariant* value) {
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_VARIANT)) {
+    g_autoptr(GVariant) inner = g_variant_get_variant(value);
+    return XfconfValueToText(inner);
+  }
+  switch (g_variant_get_type_string(value)[0]) {
+    case 's':
+      return g_variant_get_string(value, nullptr);
+    case 'b':
+      return g_variant_get_boolean(value) ? "true" : "false";
+    case 'y':
+      return std::to_string(g_variant_get_byte(value));
+    case 'n':
+      return std::to_string(g_variant_get_int16(value));
+    case 'q':
+      return std::to_string(g_variant_get_uint16(value));
+    case 'i':
+      return std::to_string(g_variant_get_int32(value));
+    case 'u':
+      return std::to_string(g_variant_get_uint32(value));
+    case 'x':
+      return std::to_string(g_variant_get_int64(value));
+    case 't':
+      return std::to_string(g_variant_get_uint64(value));
+    case 'd': {
+      std::ostringstream oss;
+      oss << g_variant_get_double(value);
+      return oss.str();
+    }
+    default: {
+      g_autofree gchar* printed = g_variant_print(value, FALSE);
+      return printed;
+    }
   }
-  std::ostringstream create;
-  create << "xfconf-query -c " << channel << " -p " << property << " -n";
+}
+
+// |text| as a value of xfconf-query's |type| ("string", "bool" or "int").
+GVariant* XfconfValueFromText(const std::string& type, const std::string& text) {
+  if (type == "bool") {
+    std::string lower = TrimWhitespace(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
+      return static_cast<char>(std::tolower(c));
+    });
+    return g_variant_new_boolean(lower == "true" || lower == "1");
+  }
+  if (type == "int") {
+    std::string trimmed = TrimWhitespace(text);
+    char* end = nullptr;
+    long value = std::strtol(trimmed.c_str(), &end, 10);
+    if (trimmed.empty() || *end != '\0') return nullptr;
+    return g_variant_new_int32(static_cast<gint32>(value));
+  }
+  return g_variant_new_string(text.c_str());
+}
+
+// Xfconf arrays travel as "av", one boxed value per element.
+GVariant* XfconfStringArray(const std::vector<std::string>& values) {
+  std::vector<GVariant*> items;
   for (const auto& value : values) {
-    create << " -t string -s " << QuoteForShell(value);
-  }
-  create << " 2>/dev/null";
-  CommandResult res = RunCommandQuiet(create.str());
-  if (res.exit_code != 0) {
-    std::ostringstream oss;
-    oss << "ProxyManager: failed to set XFCE list property " << property;
-    defyx_core::LogMessage(oss.str());
-    return false;
+    items.push_back(g_variant_new_variant(g_variant_new_string(value.c_str())));
   }
-  return true;
+  return g_variant_new_array(G_VARIANT_TYPE_VARIANT, items.data(), items.size());
 }
 
-std::string DetectXfceChannel() {
-  if (!CommandExists("xfconf-query")) return "";
-  const auto& channels = CandidateXfceChannels();
-  for (const auto& channel : channels) {
-    if (XfconfPropertyExists(channel, "/general/ProxyMode")) {
-      return channel;
+// Xfconf has no call that sets several properties at once, so a batch sends
+// every SetProperty/ResetProperty up front and then collects the replies: one
+// round trip to xfconfd rather than one per property. The replies are
+// dispatched on a private main context, never on the caller's loop.
+class XfconfBatch {
+ public:
+  XfconfBatch(GDBusConnection* bus, std::string channel)
+      : bus_(bus), channel_(std::move(channel)), context_(g_main_context_new()) {
+    g_main_context_push_thread_default(context_);
+  }
+
+  ~XfconfBatch() {
+    Wait();
+    g_main_context_pop_thread_default(context_);
+    g_main_context_unref(context_);
+  }
+
+  XfconfBatch(const XfconfBatch&) = delete;
+  XfconfBatch& operator=(const XfconfBatch&) = delete;
+
+  // Takes ownership of a floating |value|; null counts as a failed set.
+  void Set(const std::string& property, GVariant* value) {
+    if (!value) {
+      defyx_core::LogMessage("ProxyManager: invalid value for XFCE property " + property);
+      failed_ = true;
+      return;
     }
+    Send("SetProperty", property, g_variant_new("(ssv)", channel_.c_str(), property.c_str(), value), false);
   }
 
-  for (const auto& channel : channels) {
-    std::string command = "xfconf-query -c " + channel + " -l 2>/dev/null";
-    CommandResult res = RunCommandQuiet(command);
-    if (res.exit_code == 0) {
-      return channel;
+  void SetStringList(const std::string& property, const std::vector<std::string>& values) {
+    // Xfconf can't store an empty array; no entries means no property.
+    if (values.empty()) {
+      Reset(property);
+    } else {
+      Set(property, XfconfStringArray(values));
     }
   }
 
-  if (!channels.empty()) {
-    return channels.front();
+  // Resetting a property that isn't set is not a failure.
+  void Reset(const std::string& property) {
+    Send("ResetProperty", property, g_variant_new("(ssb)", channel_.c_str(), property.c_str(), FALSE), true);
   }
-  return "";
+
+  // Waits for every outstanding reply. False if any call failed.
+  bool Commit() {
+    Wait();
+    return !failed_;
+  }
+
+ private:
+  struct PendingCall {
+    XfconfBatch* batch;
+    std::string property;
+    bool reset;
+  };
+
+  void Send(const char* method, const std::string& property, GVariant* parameters, bool reset) {
+    ++pending_;
+    g_dbus_connection_call(bus_, kXfconfService, kXfconfPath, kXfconfInterface, method, parameters, nullptr,
+                           G_DBUS_CALL_FLAGS_NONE, kXfconfCallTimeoutMs, nullptr, &XfconfBatch::OnReply,
+                           new PendingCall{this, property, reset});
+  }
+
+  void Wait() {
+    while (pending_ > 0) {
+      g_main_context_iteration(context_, TRUE);
+    }
+  }
+
+  static void OnReply(GObject* source, GAsyncResult* result, gpointer data) {
+    std::unique_ptr<PendingCall> call(static_cast<PendingCall*>(data));
+    GError* error = nullptr;
+    GVariant* reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+    if (reply) {
+      g_variant_unref(reply);
+    } else if (call->reset && IsXfconfError(error, "PropertyNotFound")) {
+      g_error_free(error);
+    } else {
+      defyx_core::LogMessage("ProxyManager: failed to update XFCE property " + call->property + ": " +
+                             error->message);
+      g_error_free(error);
+      call->batch->failed_ = true;
+    }
+    --call->batch->pending_;
+  }
+
+  GDBusConnection* bus_;
+  std::string channel_;
+  GMainContext* context_;
+  int pending_ = 0;
+  bool failed_ = false;
+};
+
+// |exists| is set when the channel is one xfconfd already has.
+std::string DetectXfceChannel(GDBusConnection* bus, bool* exists) {
+  const auto& candidates = CandidateXfceChannels();
+  std::vector<std::string> listed;
+  g_autoptr(GVariant) reply = XfconfCall(bus, "ListChannels", nullptr, G_VARIANT_TYPE("(as)"), nullptr);
+  if (reply) {
+    g_autoptr(GVariant) channels = g_variant_get_child_value(reply, 0);
+    for (gsize i = 0; i < g_variant_n_children(channels); ++i) {
+      g_autoptr(GVariant) channel = g_variant_get_child_value(channels, i);
+      std::string name = g_variant_get_string(channel, nullptr);
+      if (std::find(candidates.begin(), candidates.end(), name) != candidates.end()) {
+        listed.push_back(name);
+      }
+    }
+  }
+
+  for (const auto& channel : candidates) {
+    if (std::find(listed.begin(), listed.end(), channel) != listed.end() &&
+        XfconfPropertyExists(bus, channel, "/general/ProxyMode")) {
+      *exists = true;
+      return channel;
+    }
+  }
+  for (const auto& channel : candidates) {
+    if (std::find(listed.begin(), listed.end(), channel) != listed.end()) {
+      *exists = true;
+      return channel;
+    }
+  }
+  // Setting a property creates the channel.
+  *exists = false;
+  return candidates.empty() ? "" : candidates.front();
 }
 
 std::string DefaultConfigDir() {
@@ -799,14 +966,13 @@ void SaveSnapshotToDisk(const Snapshot& snapshot) {
   }
 }
 
-bool LoadSnapshotFromDisk(Snapshot* snapshot) {
-  EnsureSnapshotPath();
-  std::ifstream ifs(g_snapshot_path.c_str());
+// Reads the key=value format the snapshot and capability cache are saved in.
+bool ReadKeyValueFile(const std::string& path, std::map<std::string, std::string>* entries) {
+  std::ifstream ifs(path.c_str());
   if (!ifs.is_open()) {
     return false;
   }
 
-  std::map<std::string, std::string> entries;
   std::string line;
   while (std::getline(ifs, line)) {
     size_t pos = line.find('=');
@@ -815,7 +981,16 @@ bool LoadSnapshotFromDisk(Snapshot* snapshot) {
     }
     std::string key = line.substr(0, pos);
     std::string value = line.substr(pos + 1);
-    entries[key] = Unescape(value);
+    (*entries)[key] = Unescape(value);
+  }
+  return true;
+}
+
+bool LoadSnapshotFromDisk(Snapshot* snapshot) {
+  EnsureSnapshotPath();
+  std::map<std::string, std::string> entries;
+  if (!ReadKeyValueFile(g_snapshot_path, &entries)) {
+    return false;
   }
 
   if (!entries.count("version")) {
@@ -1008,45 +1183,373 @@ void RestoreEnv() {
   else setenv("NO_PROXY", g_snapshot.env.no_proxy.c_str(), 1);
 }
 
-std::vector<std::string> DiscoverGsettingsSchemas() {
-  std::vector<std::string> discovered;
-  if (!CommandExists("gsettings")) {
-    return discovered;
+// A proxy schema (group "") and its http/https/socks/ftp children, opened in
+// delayed-apply mode: writes collect in each GSettings object until Apply()
+// commits each object's changes as one transaction. Nothing reaches dconf
+// before that, and g_settings_sync() waits until it has.
+class GsettingsProxySchema {
+ public:
+  explicit GsettingsProxySchema(const std::string& schema) : schema_(schema) {
+    Open("", schema);
+    for (const char* group : {"http", "https", "socks", "ftp"}) {
+      Open(group, MakeSubSchema(schema, group));
+    }
+  }
+
+  ~GsettingsProxySchema() {
+    for (auto& entry : nodes_) {
+      // Anything not applied by now is dropped with the object.
+      g_object_unref(entry.second.settings);
+      g_settings_schema_unref(entry.second.schema);
+    }
+  }
+
+  GsettingsProxySchema(const GsettingsProxySchema&) = delete;
+  GsettingsProxySchema& operator=(const GsettingsProxySchema&) = delete;
+
+  bool Has(const std::string& group, const char* key) const {
+    const Node* node = Find(group);
+    return node && g_settings_schema_has_key(node->schema, key);
+  }
+
+  // The value as `gsettings get` prints it, e.g. 'manual' or uint32 8080, which
+  // is the form the snapshot file has always stored.
+  bool Read(const std::string& group, const char* key, std::string* out) const {
+    if (!Has(group, key)) return false;
+    g_autoptr(GVariant) value = g_settings_get_value(Find(group)->settings, key);
+    g_autofree gchar* text = g_variant_print(value, TRUE);
+    *out = text;
+    return true;
+  }
+
+  // Sinks |value| if it is floating. Fails quietly for a missing key, and with
+  // a log line when the key has another type or range.
+  bool Write(const std::string& group, const char* key, GVariant* value) {
+    g_autoptr(GVariant) owned = g_variant_ref_sink(value);
+    if (!Has(group, key)) return false;
+    const Node* node = Find(group);
+    g_autoptr(GSettingsSchemaKey) schema_key = g_settings_schema_get_key(node->schema, key);
+    if (!g_variant_is_of_type(owned, g_settings_schema_key_get_value_type(schema_key)) ||
+        !g_settings_schema_key_range_check(schema_key, owned)) {
+      defyx_core::LogMessage("ProxyManager: gsettings(" + Id(group) + ") rejected value for " + key);
+      return false;
+    }
+    return g_settings_set_value(node->settings, key, owned);
+  }
+
+  bool WriteString(const std::string& group, const char* key, const std::string& value) {
+    return Write(group, key, g_variant_new_string(value.c_str()));
+  }
+
+  bool WriteBool(const std::string& group, const char* key, bool value) {
+    return Write(group, key, g_variant_new_boolean(value));
+  }
+
+  bool WriteStrings(const std::string& group, const char* key, const std::vector<std::string>& values) {
+    std::vector<const gchar*> items;
+    for (const auto& value : values) items.push_back(value.c_str());
+    items.push_back(nullptr);
+    return Write(group, key, g_variant_new_strv(items.data(), -1));
+  }
+
+  // GNOME's port keys are int32; some forks declare them unsigned.
+  bool WritePort(const std::string& group, const char* key, int port) {
+    if (!Has(group, key)) return false;
+    g_autoptr(GSettingsSchemaKey) schema_key = g_settings_schema_get_key(Find(group)->schema, key);
+    const GVariantType* type = g_settings_schema_key_get_value_type(schema_key);
+    if (g_variant_type_equal(type, G_VARIANT_TYPE_INT32)) {
+      return Write(group, key, g_variant_new_int32(port));
+    }
+    if (g_variant_type_equal(type, G_VARIANT_TYPE_UINT32)) {
+      return Write(group, key, g_variant_new_uint32(static_cast<guint32>(port)));
+    }
+    if (g_variant_type_equal(type, G_VARIANT_TYPE_UINT16)) {
+      return Write(group, key, g_variant_new_uint16(static_cast<uint16_t>(port)));
+    }
+    return false;
+  }
+
+  // |text| in the snapshot's `gsettings get` form, parsed as the key's type.
+  bool WriteText(const std::string& group, const char* key, const std::string& text) {
+    if (!Has(group, key)) return false;
+    g_autoptr(GSettingsSchemaKey) schema_key = g_settings_schema_get_key(Find(group)->schema, key);
+    const GVariantType* type = g_settings_schema_key_get_value_type(schema_key);
+    std::string trimmed = TrimWhitespace(text);
+    g_autoptr(GVariant) parsed = g_variant_parse(type, trimmed.c_str(), nullptr, nullptr, nullptr);
+    std::string normalized;
+    if (!parsed && NormalizeGsettingsValueForSet(text, &normalized)) {
+      parsed = g_variant_parse(type, normalized.c_str(), nullptr, nullptr, nullptr);
+    }
+    if (!parsed) {
+      defyx_core::LogMessage("ProxyManager: gsettings(" + Id(group) + ") could not parse saved " + key + ": " + trimmed);
+      return false;
+    }
+    return Write(group, key, parsed);
+  }
+
+  void Apply() {
+    for (auto& entry : nodes_) {
+      g_settings_apply(entry.second.settings);
+    }
+  }
+
+ private:
+  struct Node {
+    GSettingsSchema* schema;
+    GSettings* settings;
+  };
+
+  void Open(const std::string& group, const std::string& id) {
+    GSettingsSchema* schema = LookupGsettingsSchema(id);
+    if (!schema) return;
+    GSettings* settings = g_settings_new_full(schema, nullptr, nullptr);
+    g_settings_delay(settings);
+    nodes_.emplace(group, Node{schema, settings});
+  }
+
+  const Node* Find(const std::string& group) const {
+    auto it = nodes_.find(group);
+    return it == nodes_.end() ? nullptr : &it->second;
+  }
+
+  std::string Id(const std::string& group) const {
+    return group.empty() ? schema_ : MakeSubSchema(schema_, group);
+  }
+
+  std::string schema_;
+  std::map<std::string, Node> nodes_;
+};
+
+// Capability cache. Discovering what this desktop supports means listing every
+// installed GSettings schema and several session bus calls, yet the answer
+// only changes when the session or the installed packages do. It is kept in
+// memory and in the persistent cache tier, keyed on a fingerprint of those
+// inputs; a fingerprint that no longer matches means probing again.
+constexpr int kCapabilitiesVersion = 1;
+constexpr const char* kCapabilitiesFile = "proxy_capabilities.cfg";
+
+ProxyCapabilities g_capabilities;
+
+std::vector<std::string> SplitPathList(const char* value, const char* fallback) {
+  std::vector<std::string> dirs;
+  std::string list = value && *value ? value : (fallback ? fallback : "");
+  std::stringstream ss(list);
+  std::string dir;
+  while (std::getline(ss, dir, ':')) {
+    if (!dir.empty()) dirs.push_back(dir);
+  }
+  return dirs;
+}
+
+// The XDG data dirs, user first, in the order GIO and the bus daemon search.
+std::vector<std::string> XdgDataDirs() {
+  std::vector<std::string> dirs;
+  const char* data_home = std::getenv("XDG_DATA_HOME");
+  const char* home = std::getenv("HOME");
+  if (data_home && *data_home) {
+    dirs.push_back(data_home);
+  } else if (home && *home) {
+    dirs.push_back(std::string(home) + "/.local/share");
+  }
+  for (const auto& dir : SplitPathList(std::getenv("XDG_DATA_DIRS"), "/usr/local/share:/usr/share")) {
+    dirs.push_back(dir);
+  }
+  return dirs;
+}
+
+std::string MtimeToken(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return "-";
+  return std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+}
+
+// Installing or removing a package rewrites gschemas.compiled or adds a bus
+// service file, and either bumps its directory's mtime.
+std::string CapabilityFingerprint() {
+  std::ostringstream oss;
+  oss << "desktop=" << JoinStrings(DesktopTokens(), ',');
+  const char* bus = std::getenv("DBUS_SESSION_BUS_ADDRESS");
+  oss << ";bus=" << (bus ? bus : "");
+  for (const auto& dir : SplitPathList(std::getenv("GSETTINGS_SCHEMA_DIR"), nullptr)) {
+    oss << ';' << dir << '=' << MtimeToken(dir);
+  }
+  for (const auto& data_dir : XdgDataDirs()) {
+    std::string schemas = data_dir + "/glib-2.0/schemas";
+    std::string services = data_dir + "/dbus-1/services";
+    oss << ';' << schemas << '=' << MtimeToken(schemas);
+    oss << ';' << services << '=' << MtimeToken(services);
+  }
+  return oss.str();
+}
+
+// Reads the compiled schemas from disk again, in GIO's search order: each
+// directory's source chains to the lower-priority ones, so the data dirs go in
+// last to first, then the user's, then $GSETTINGS_SCHEMA_DIR.
+void RebuildSchemaSource() {
+  std::vector<std::string> dirs = SplitPathList(std::getenv("GSETTINGS_SCHEMA_DIR"), nullptr);
+  for (const auto& data_dir : XdgDataDirs()) {
+    dirs.push_back(data_dir + "/glib-2.0/schemas");
+  }
+
+  GSettingsSchemaSource* source = nullptr;
+  for (auto dir = dirs.rbegin(); dir != dirs.rend(); ++dir) {
+    // Directories without a gschemas.compiled just fail and are skipped.
+    GSettingsSchemaSource* next = g_settings_schema_source_new_from_directory(dir->c_str(), source, TRUE, nullptr);
+    if (!next) continue;
+    if (source) g_settings_schema_source_unref(source);
+    source = next;
+  }
+  if (g_schema_source) g_settings_schema_source_unref(g_schema_source);
+  g_schema_source = source;
+  g_schema_source_rebuilt = true;
+}
+
+// Every installed schema with the keys the gsettings backend needs, known
+// candidates first. Membership doesn't depend on the desktop; ordering for
+// this session is done by DiscoverGsettingsSchemas.
+std::vector<std::string> ProbeGsettingsSchemas() {
+  std::vector<std::string> supported;
+  GSettingsSchemaSource* source = SchemaSource();
+  if (!source) {
+    return supported;
   }
 
-  auto candidates = CandidateGsettingsSchemas();
   auto add_if_supported = [&](const std::string& schema) {
     if (schema.empty()) return;
-    if (std::find(discovered.begin(), discovered.end(), schema) != discovered.end()) return;
+    if (std::find(supported.begin(), supported.end(), schema) != supported.end()) return;
     if (!GSettingsKeyExists(schema, "mode")) return;
     if (!GSettingsKeyExists(MakeSubSchema(schema, "http"), "host")) return;
-    discovered.push_back(schema);
+    supported.push_back(schema);
   };
 
-  for (const auto& schema : candidates) {
+  for (const auto& schema : KnownGsettingsSchemas()) {
     add_if_supported(schema);
   }
 
-  auto collect_from_command = [&](const std::string& command) {
-    CommandResult res = RunCommandQuiet(command);
-    if (res.exit_code != 0) return;
-    std::stringstream ss(res.output);
-    std::string line;
-    while (std::getline(ss, line)) {
-      std::string trimmed = TrimWhitespace(line);
-      if (trimmed.find(".proxy") == std::string::npos) continue;
-      add_if_supported(trimmed);
+  // Relocatable schemas are skipped: they can't be opened without a path.
+  gchar** installed = nullptr;
+  g_settings_schema_source_list_schemas(source, TRUE, &installed, nullptr);
+  for (gchar** id = installed; id && *id; ++id) {
+    std::string schema = *id;
+    if (schema.find(".proxy") == std::string::npos) continue;
+    add_if_supported(schema);
+  }
+  g_strfreev(installed);
+
+  return supported;
+}
+
+std::string CapabilitiesPath() {
+  std::string dir = cache_manager::Dir(cache_manager::Tier::kPersistent);
+  return dir.empty() ? std::string() : dir + "/" + kCapabilitiesFile;
+}
+
+bool LoadCapabilities(ProxyCapabilities* capabilities) {
+  std::string path = CapabilitiesPath();
+  std::map<std::string, std::string> entries;
+  if (path.empty() || !ReadKeyValueFile(path, &entries)) {
+    return false;
+  }
+  if (std::strtol(entries["version"].c_str(), nullptr, 10) != kCapabilitiesVersion) {
+    return false;
+  }
+  capabilities->fingerprint = entries["fingerprint"];
+  capabilities->gsettings_schemas = SplitString(entries["gsettings_schemas"], ',');
+  capabilities->xfconf_available = entries["xfconf_available"] == "1";
+  capabilities->xfce_channel = entries["xfce_channel"];
+  return !capabilities->fingerprint.empty();
+}
+
+// Written aside and renamed into place: a torn file would read as "nothing
+// supported" under a fingerprint that still matches.
+void SaveCapabilities(const ProxyCapabilities& capabilities) {
+  std::string path = CapabilitiesPath();
+  if (path.empty()) return;
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream ofs(tmp.c_str(), std::ios::trunc);
+    ofs << "version=" << kCapabilitiesVersion << "\n";
+    ofs << "fingerprint=" << Escape(capabilities.fingerprint) << "\n";
+    ofs << "gsettings_schemas=" << Escape(JoinStrings(capabilities.gsettings_schemas, ',')) << "\n";
+    ofs << "xfconf_available=" << (capabilities.xfconf_available ? "1" : "0") << "\n";
+    ofs << "xfce_channel=" << Escape(capabilities.xfce_channel) << "\n";
+    if (!ofs) {
+      defyx_core::LogMessage("ProxyManager: failed to write capability cache");
+      return;
     }
-  };
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+ProxyCapabilities& Capabilities() {
+  std::string fingerprint = CapabilityFingerprint();
+  if (g_capabilities.fingerprint == fingerprint) {
+    return g_capabilities;
+  }
+  // Whether the list comes from disk or a probe, the schemas it names have to
+  // be looked up in a source at least as new as the fingerprint.
+  RebuildSchemaSource();
+
+  ProxyCapabilities loaded;
+  if (LoadCapabilities(&loaded) && loaded.fingerprint == fingerprint) {
+    g_capabilities = std::move(loaded);
+    defyx_core::LogMessage("ProxyManager: reusing cached desktop capabilities");
+    return g_capabilities;
+  }
+
+  connect_trace::Span span("proxy.probe", "proxy");
+  ProxyCapabilities probed;
+  probed.fingerprint = fingerprint;
+  probed.gsettings_schemas = ProbeGsettingsSchemas();
+  probed.xfconf_available = XfconfAvailable();
+  g_capabilities = std::move(probed);
+  SaveCapabilities(g_capabilities);
+  defyx_core::LogMessage("ProxyManager: probed desktop capabilities (" +
+                         std::to_string(g_capabilities.gsettings_schemas.size()) + " gsettings schemas, xfconf " +
+                         (g_capabilities.xfconf_available ? "available" : "unavailable") + ")");
+  return g_capabilities;
+}
+
+// The cached channel is only one xfconfd confirmed exists; the fallback for a
+// session with none of the candidates yet is worked out again each time.
+std::string XfceChannel(GDBusConnection* bus) {
+  ProxyCapabilities& capabilities = Capabilities();
+  if (!capabilities.xfce_channel.empty()) {
+    return capabilities.xfce_channel;
+  }
+  bool exists = false;
+  std::string channel = DetectXfceChannel(bus, &exists);
+  if (exists) {
+    capabilities.xfce_channel = channel;
+    SaveCapabilities(capabilities);
+  }
+  return channel;
+}
 
-  collect_from_command("gsettings list-schemas");
-  collect_from_command("gsettings list-relocatable-schemas");
+std::vector<std::string> DiscoverGsettingsSchemas() {
+  std::vector<std::string> discovered;
+  const auto& supported = Capabilities().gsettings_schemas;
+  auto add_if_supported = [&](const std::string& schema) {
+    if (std::find(supported.begin(), supported.end(), schema) == supported.end()) return;
+    if (std::find(discovered.begin(), discovered.end(), schema) != discovered.end()) return;
+    discovered.push_back(schema);
+  };
 
+  for (const auto& schema : CandidateGsettingsSchemas()) {
+    add_if_supported(schema);
+  }
+  for (const auto& schema : supported) {
+    add_if_supported(schema);
+  }
   return discovered;
 }
 
 void CaptureGsettings() {
-  if (!CommandExists("gsettings")) return;
+  if (!GsettingsAvailable()) return;
 
   auto schemas = DiscoverGsettingsSchemas();
   for (const auto& schema : schemas) {
@@ -1056,36 +1559,16 @@ void CaptureGsettings() {
     }
 
     snapshot->captured = true;
+    GsettingsProxySchema settings(schema);
 
-    auto capture_key = [&](const std::string& full_schema, const std::string& key, std::string* target, bool* supported_flag = nullptr) {
-      if (!GSettingsKeyExists(full_schema, key)) {
-        if (supported_flag) *supported_flag = false;
-        return false;
-      }
-      CommandResult res = RunCommand("gsettings get " + full_schema + " " + key);
-      if (res.exit_code == 0) {
-        if (target) *target = res.output;
-        if (supported_flag) *supported_flag = true;
-        return true;
-      }
-      if (supported_flag) *supported_flag = false;
-      return false;
-    };
-
-    capture_key(schema, "mode", &snapshot->mode);
-    snapshot->supports_use_same_proxy = false;
-    capture_key(schema, "use-same-proxy", &snapshot->use_same_proxy, &snapshot->supports_use_same_proxy);
-    snapshot->supports_ignore_hosts = false;
-    capture_key(schema, "ignore-hosts", &snapshot->ignore_hosts, &snapshot->supports_ignore_hosts);
+    settings.Read("", "mode", &snapshot->mode);
+    snapshot->supports_use_same_proxy = settings.Read("", "use-same-proxy", &snapshot->use_same_proxy);
+    snapshot->supports_ignore_hosts = settings.Read("", "ignore-hosts", &snapshot->ignore_hosts);
 
     auto capture_group = [&](const std::string& group, std::string* host, std::string* port, std::string* enabled, bool* enabled_supported) {
-      std::string sub_schema = MakeSubSchema(schema, group);
-      capture_key(sub_schema, "host", host);
-      capture_key(sub_schema, "port", port);
-      if (enabled && enabled_supported) {
-        *enabled_supported = false;
-        capture_key(sub_schema, "enabled", enabled, enabled_supported);
-      }
+      settings.Read(group, "host", host);
+      settings.Read(group, "port", port);
+      *enabled_supported = settings.Read(group, "enabled", enabled);
     };
 
     capture_group("http", &snapshot->http_host, &snapshot->http_port, &snapshot->http_enabled, &snapshot->supports_http_enabled);
@@ -1103,111 +1586,61 @@ void CaptureGsettings() {
   }
 }
 
-std::string QuoteForGSettings(const std::string& value) {
-  std::string trimmed = value;
-  // Remove trailing newline if exists
-  while (!trimmed.empty() && (trimmed.back() == '\n' || trimmed.back() == '\r')) {
-    trimmed.pop_back();
-  }
-  if (trimmed.size() >= 2 && trimmed.front() == '\'' && trimmed.back() == '\'') {
-    return trimmed;
-  }
-  return "'" + trimmed + "'";
-}
-
 bool ApplyGsettingsSchema(const ProxyConfig& config, GsettingsSnapshot* snapshot) {
   if (!snapshot) return false;
   const std::string& schema = snapshot->schema;
-  if (!GSettingsKeyExists(schema, "mode")) return false;
+  GsettingsProxySchema settings(schema);
+  if (!settings.Has("", "mode")) return false;
 
-  std::ostringstream ignore;
   std::string no_proxy = config.no_proxy.empty() ? "localhost,127.0.0.1,::1" : config.no_proxy;
-  ignore << "[";
-  std::stringstream ss(no_proxy);
-  std::string item;
-  bool first = true;
-  while (std::getline(ss, item, ',')) {
-    if (item.empty()) continue;
-    if (!first) ignore << ", ";
-    ignore << "'" << item << "'";
-    first = false;
-  }
-  ignore << "]";
-
-  std::ostringstream port_str;
-  port_str << config.port;
 
-  std::string host_quoted = QuoteForGSettings(config.host);
-  std::string port_command = port_str.str();
-  RunCommand("gsettings set " + schema + " mode 'manual'");
+  // Optional keys are only written where the schema has them; every write that
+  // is attempted has to land for the schema to count as applied.
+  bool ok = settings.WriteString("", "mode", "manual");
 
-  bool use_same_proxy_supported = snapshot->supports_use_same_proxy || GSettingsKeyExists(schema, "use-same-proxy");
-  if (use_same_proxy_supported) {
+  if (settings.Has("", "use-same-proxy")) {
     snapshot->supports_use_same_proxy = true;
-    RunCommand("gsettings set " + schema + " use-same-proxy true");
+    ok = settings.WriteBool("", "use-same-proxy", true) && ok;
   }
 
-  auto apply_group = [&](const std::string& group, bool enable_flag) {
-    std::string sub_schema = MakeSubSchema(schema, group);
-    if (GSettingsKeyExists(sub_schema, "host")) {
-      RunCommand("gsettings set " + sub_schema + " host " + host_quoted);
+  auto apply_group = [&](const std::string& group) {
+    if (settings.Has(group, "host")) {
+      ok = settings.WriteString(group, "host", config.host) && ok;
     }
-    if (GSettingsKeyExists(sub_schema, "port")) {
-      RunCommand("gsettings set " + sub_schema + " port " + port_command);
+    if (settings.Has(group, "port")) {
+      ok = settings.WritePort(group, "port", config.port) && ok;
     }
-    if (enable_flag && GSettingsKeyExists(sub_schema, "enabled")) {
-      RunCommand("gsettings set " + sub_schema + " enabled true");
+    if (settings.Has(group, "enabled")) {
+      ok = settings.WriteBool(group, "enabled", true) && ok;
     }
   };
 
-  apply_group("http", true);
-  apply_group("https", true);
-  apply_group("socks", true);
+  apply_group("http");
+  apply_group("https");
+  apply_group("socks");
 
-  std::string ftp_schema = MakeSubSchema(schema, "ftp");
-  bool ftp_supported = snapshot->supports_ftp || GSettingsKeyExists(ftp_schema, "host") || GSettingsKeyExists(ftp_schema, "port");
-  if (ftp_supported) {
-    if (GSettingsKeyExists(ftp_schema, "host")) {
-      RunCommand("gsettings set " + ftp_schema + " host " + host_quoted);
-    }
-    if (GSettingsKeyExists(ftp_schema, "port")) {
-      RunCommand("gsettings set " + ftp_schema + " port " + port_command);
-    }
-    bool ftp_enable_supported = snapshot->supports_ftp_enabled || GSettingsKeyExists(ftp_schema, "enabled");
-    if (ftp_enable_supported) {
+  if (snapshot->supports_ftp || settings.Has("ftp", "host") || settings.Has("ftp", "port")) {
+    apply_group("ftp");
+    if (settings.Has("ftp", "enabled")) {
       snapshot->supports_ftp_enabled = true;
-      RunCommand("gsettings set " + ftp_schema + " enabled true");
     }
     snapshot->supports_ftp = true;
   }
 
-  bool ignore_hosts_supported = snapshot->supports_ignore_hosts || GSettingsKeyExists(schema, "ignore-hosts");
-  if (ignore_hosts_supported) {
+  if (settings.Has("", "ignore-hosts")) {
     snapshot->supports_ignore_hosts = true;
-    RunCommand("gsettings set " + schema + " ignore-hosts \"" + ignore.str() + "\"");
+    ok = settings.WriteStrings("", "ignore-hosts", SplitString(no_proxy, ',')) && ok;
   }
 
-  auto log_if_mismatch = [&](const std::string& label, const std::string& full_schema, const std::string& key, const std::string& expected, const std::string& alt_expected = std::string()) {
-    CommandResult current = RunCommand("gsettings get " + full_schema + " " + key);
-    if (current.exit_code != 0) return;
-    std::string trimmed = TrimWhitespace(current.output);
-    if (trimmed != expected && (alt_expected.empty() || trimmed != alt_expected)) {
-      defyx_core::LogMessage("ProxyManager: gsettings(" + schema + ") " + label + " mismatch -> got: " + trimmed + ", expected: " + expected);
-    }
-  };
-
-  log_if_mismatch("mode", schema, "mode", "'manual'");
-  std::string expected_host = "'" + config.host + "'";
-  std::string http_schema = MakeSubSchema(schema, "http");
-  log_if_mismatch("http host", http_schema, "host", expected_host);
-  std::string port_value = std::to_string(config.port);
-  log_if_mismatch("http port", http_schema, "port", port_value, "uint32 " + port_value);
-
-  return true;
+  if (!ok) {
+    defyx_core::LogMessage("ProxyManager: gsettings(" + schema + ") rejected part of the proxy settings");
+  }
+  settings.Apply();
+  return ok;
 }
 
 bool ApplyGsettings(const ProxyConfig& config) {
-  if (!CommandExists("gsettings")) return false;
+  if (!GsettingsAvailable()) return false;
   CaptureGsettings();
 
   bool applied = false;
@@ -1218,149 +1651,326 @@ bool ApplyGsettings(const ProxyConfig& config) {
       applied = true;
     }
   }
+  // One round trip for every schema's transaction.
+  g_settings_sync();
   return applied;
 }
 
 void RestoreGsettings() {
-  if (!CommandExists("gsettings")) return;
-
-  auto set_if_supported = [](const std::string& schema, const std::string& key, const std::string& value, bool supported) {
-    if (schema.empty()) {
-      defyx_core::LogMessage("ProxyManager: skipping gsettings restore for empty schema key=" + key);
-      return;
-    }
-    if (!supported) return;
-    if (value.empty()) return;
-    if (!GSettingsKeyExists(schema, key)) return;
-    std::string formatted;
-    if (!NormalizeGsettingsValueForSet(value, &formatted)) return;
-    RunCommand("gsettings set " + schema + " " + key + " " + formatted);
-  };
+  if (!GsettingsAvailable()) return;
 
   for (auto& snapshot : g_snapshot.gsettings) {
     if (!snapshot.captured) continue;
-    if (!GSettingsKeyExists(snapshot.schema, "mode")) continue;
+    if (snapshot.schema.empty()) {
+      defyx_core::LogMessage("ProxyManager: skipping gsettings restore for empty schema");
+      continue;
+    }
+    GsettingsProxySchema settings(snapshot.schema);
+    if (!settings.Has("", "mode")) continue;
 
-    set_if_supported(snapshot.schema, "mode", snapshot.mode, true);
-    set_if_supported(snapshot.schema, "use-same-proxy", snapshot.use_same_proxy, snapshot.supports_use_same_proxy);
-    set_if_supported(snapshot.schema, "ignore-hosts", snapshot.ignore_hosts, snapshot.supports_ignore_hosts);
+    auto restore = [&](const std::string& group, const char* key, const std::string& value, bool supported) {
+      if (!supported || value.empty()) return;
+      settings.WriteText(group, key, value);
+    };
+
+    restore("", "mode", snapshot.mode, true);
+    restore("", "use-same-proxy", snapshot.use_same_proxy, snapshot.supports_use_same_proxy);
+    restore("", "ignore-hosts", snapshot.ignore_hosts, snapshot.supports_ignore_hosts);
 
-    auto set_group = [&](const std::string& group, const std::string& host_val, const std::string& port_val, const std::string& enabled_val, bool enabled_supported) {
-      std::string sub_schema = MakeSubSchema(snapshot.schema, group);
-      set_if_supported(sub_schema, "host", host_val, !host_val.empty());
-      set_if_supported(sub_schema, "port", port_val, !port_val.empty());
-      set_if_supported(sub_schema, "enabled", enabled_val, enabled_supported);
+    auto restore_group = [&](const std::string& group, const std::string& host_val, const std::string& port_val, const std::string& enabled_val, bool enabled_supported) {
+      restore(group, "host", host_val, true);
+      restore(group, "port", port_val, true);
+      restore(group, "enabled", enabled_val, enabled_supported);
     };
 
-    set_group("http", snapshot.http_host, snapshot.http_port, snapshot.http_enabled, snapshot.supports_http_enabled);
-    set_group("https", snapshot.https_host, snapshot.https_port, snapshot.https_enabled, snapshot.supports_https_enabled);
-    set_group("socks", snapshot.socks_host, snapshot.socks_port, snapshot.socks_enabled, snapshot.supports_socks_enabled);
-    set_group("ftp", snapshot.ftp_host, snapshot.ftp_port, snapshot.ftp_enabled, snapshot.supports_ftp_enabled);
+    restore_group("http", snapshot.http_host, snapshot.http_port, snapshot.http_enabled, snapshot.supports_http_enabled);
+    restore_group("https", snapshot.https_host, snapshot.https_port, snapshot.https_enabled, snapshot.supports_https_enabled);
+    restore_group("socks", snapshot.socks_host, snapshot.socks_port, snapshot.socks_enabled, snapshot.supports_socks_enabled);
+    restore_group("ftp", snapshot.ftp_host, snapshot.ftp_port, snapshot.ftp_enabled, snapshot.supports_ftp_enabled);
+
+    settings.Apply();
   }
+  g_settings_sync();
 }
 
-void CaptureKde() {
-  if (g_snapshot.kde.captured) return;
-  if (!CommandExists("kreadconfig5")) return;
+// Plasma 5 and 6 both keep proxy settings in $XDG_CONFIG_HOME/kioslaverc;
+// kwriteconfig5/6 only differ in which KF version they link.
+constexpr const char* kKdeProxyGroup = "Proxy Settings";
 
-  g_snapshot.kde.captured = true;
-  g_snapshot.kde.proxy_type = RunCommand("kreadconfig5 --file kioslaverc --group 'Proxy Settings' --key ProxyType").output;
-  g_snapshot.kde.http_proxy = RunCommand("kreadconfig5 --file kioslaverc --group 'Proxy Settings' --key httpProxy").output;
-  g_snapshot.kde.https_proxy = RunCommand("kreadconfig5 --file kioslaverc --group 'Proxy Settings' --key httpsProxy").output;
-  g_snapshot.kde.socks_proxy = RunCommand("kreadconfig5 --file kioslaverc --group 'Proxy Settings' --key socksProxy").output;
-  g_snapshot.kde.ftp_proxy = RunCommand("kreadconfig5 --file kioslaverc --group 'Proxy Settings' --key ftpProxy").output;
-  g_snapshot.kde.no_proxy_for = RunCommand("kreadconfig5 --file kioslaverc --group 'Proxy Settings' --key NoProxyFor").output;
+std::string KioslavercPath() {
+  return DefaultConfigDir() + "/kioslaverc";
 }
 
-std::string QuoteForShell(const std::string& value) {
-  std::ostringstream oss;
-  oss << "'";
+bool KdeConfigDetected() {
+  const char* version = std::getenv("KDE_SESSION_VERSION");
+  const char* full_session = std::getenv("KDE_FULL_SESSION");
+  return (version && *version) || (full_session && *full_session) || std::filesystem::exists(KioslavercPath());
+}
+
+// KConfig escapes backslashes, control characters, and a leading or trailing
+// space (which its reader would otherwise trim) as \s.
+std::string KConfigEscape(const std::string& value) {
+  std::string escaped;
   for (size_t i = 0; i < value.size(); ++i) {
-    if (value[i] == '\'') {
-      oss << "'\\''";
+    char c = value[i];
+    if (c == '\\') escaped += "\\\\";
+    else if (c == '\n') escaped += "\\n";
+    else if (c == '\r') escaped += "\\r";
+    else if (c == '\t') escaped += "\\t";
+    else if (c == ' ' && (i == 0 || i + 1 == value.size())) escaped += "\\s";
+    else escaped.push_back(c);
+  }
+  return escaped;
+}
+
+std::string KConfigUnescape(const std::string& value) {
+  std::string unescaped;
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] != '\\' || i + 1 >= value.size()) {
+      unescaped.push_back(value[i]);
+      continue;
+    }
+    char next = value[++i];
+    if (next == 'n') unescaped.push_back('\n');
+    else if (next == 'r') unescaped.push_back('\r');
+    else if (next == 't') unescaped.push_back('\t');
+    else if (next == 's') unescaped.push_back(' ');
+    else unescaped.push_back(next);
+  }
+  return unescaped;
+}
+
+// A KConfig file (kioslaverc) edited in memory. Lines outside the keys that
+// are written (other groups, comments, key order) are kept as they were.
+class KConfigFile {
+ public:
+  explicit KConfigFile(std::string path) : path_(std::move(path)) {
+    std::ifstream in(path_);
+    std::string line;
+    while (std::getline(in, line)) {
+      lines_.push_back(line);
+    }
+  }
+
+  // Empty when the key is absent.
+  std::string Read(const std::string& group, const std::string& key) const {
+    size_t begin = 0, end = 0;
+    if (!FindGroup(group, &begin, &end)) return "";
+    size_t line = FindKey(begin, end, key);
+    if (line == std::string::npos) return "";
+    return KConfigUnescape(TrimWhitespace(lines_[line].substr(lines_[line].find('=') + 1)));
+  }
+
+  // An empty |value| deletes the key.
+  void Write(const std::string& group, const std::string& key, const std::string& value) {
+    size_t begin = 0, end = 0;
+    bool has_group = FindGroup(group, &begin, &end);
+    size_t line = has_group ? FindKey(begin, end, key) : std::string::npos;
+    std::string entry = key + "=" + KConfigEscape(value);
+
+    if (value.empty()) {
+      if (line == std::string::npos) return;
+      lines_.erase(lines_.begin() + static_cast<std::ptrdiff_t>(line));
+    } else if (line != std::string::npos) {
+      if (lines_[line] == entry) return;
+      lines_[line] = entry;
+    } else if (has_group) {
+      // After the group's last non-blank line, ahead of the blank separator.
+      size_t insert = end;
+      while (insert > begin && TrimWhitespace(lines_[insert - 1]).empty()) --insert;
+      lines_.insert(lines_.begin() + static_cast<std::ptrdiff_t>(insert), entry);
     } else {
-      oss << value[i];
+      if (!lines_.empty() && !TrimWhitespace(lines_.back()).empty()) lines_.push_back("");
+      lines_.push_back("[" + group + "]");
+      lines_.push_back(entry);
     }
+    dirty_ = true;
+  }
+
+  bool dirty() const { return dirty_; }
+
+  // Writes a temp file next to the original, syncs it and renames it over, so
+  // KDE never reads a half-written kioslaverc. Keeps the original's permissions.
+  bool Save() {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path_).parent_path(), ec);
+    std::string contents;
+    for (const auto& line : lines_) {
+      contents += line;
+      contents += '\n';
+    }
+
+    std::string tmp = path_ + ".XXXXXX";
+    int fd = mkstemp(tmp.data());
+    if (fd < 0) {
+      defyx_core::LogMessage("ProxyManager: failed to create a temp file for " + path_ + ": " + std::strerror(errno));
+      return false;
+    }
+    mode_t mode = S_IRUSR | S_IWUSR;
+    struct stat original;
+    if (stat(path_.c_str(), &original) == 0) {
+      mode = original.st_mode & 07777;
+    }
+    bool ok = fchmod(fd, mode) == 0;
+    for (size_t written = 0; ok && written < contents.size();) {
+      ssize_t n = write(fd, contents.data() + written, contents.size() - written);
+      if (n < 0 && errno == EINTR) continue;
+      ok = n > 0;
+      if (ok) written += static_cast<size_t>(n);
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path_.c_str()) != 0) {
+      int saved_errno = errno;
+      unlink(tmp.c_str());
+      defyx_core::LogMessage("ProxyManager: failed to replace " + path_ + ": " + std::strerror(saved_errno));
+      return false;
+    }
+    dirty_ = false;
+    return true;
+  }
+
+ private:
+  // Body of [group] as the line range [*begin, *end).
+  bool FindGroup(const std::string& group, size_t* begin, size_t* end) const {
+    const std::string header = "[" + group + "]";
+    for (size_t i = 0; i < lines_.size(); ++i) {
+      if (TrimWhitespace(lines_[i]) != header) continue;
+      size_t j = i + 1;
+      while (j < lines_.size() && TrimWhitespace(lines_[j]).rfind('[', 0) != 0) ++j;
+      *begin = i + 1;
+      *end = j;
+      return true;
+    }
+    return false;
+  }
+
+  // Matches "key=..." and "key[$e]=..." but not localized "key[de]=...".
+  size_t FindKey(size_t begin, size_t end, const std::string& key) const {
+    for (size_t i = begin; i < end; ++i) {
+      const std::string& line = lines_[i];
+      size_t eq = line.find('=');
+      if (eq == std::string::npos) continue;
+      std::string name = TrimWhitespace(line.substr(0, eq));
+      size_t flags = name.find("[$");
+      if (flags != std::string::npos) name.resize(flags);
+      if (name == key) return i;
+    }
+    return std::string::npos;
+  }
+
+  std::string path_;
+  std::vector<std::string> lines_;
+  bool dirty_ = false;
+};
+
+// What systemsettings' proxy page does after saving: running KIO workers and
+// apps reread kioslaverc on this signal.
+void NotifyKdeProxyChanged() {
+  GError* error = nullptr;
+  g_autoptr(GDBusConnection) bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+  if (!bus) {
+    g_clear_error(&error);
+    return;
+  }
+  if (!g_dbus_connection_emit_signal(bus, nullptr, "/KIO/Scheduler", "org.kde.KIO.Scheduler",
+                                     "reparseSlaveConfiguration", g_variant_new("(s)", ""), &error) ||
+      !g_dbus_connection_flush_sync(bus, nullptr, &error)) {
+    defyx_core::LogMessage(std::string("ProxyManager: KIO reparse signal failed: ") + error->message);
+    g_clear_error(&error);
   }
-  oss << "'";
-  return oss.str();
 }
-bool ApplyKde(const ProxyConfig& config) {
-  if (!CommandExists("kwriteconfig5")) return false;
 
+void CaptureKde() {
+  if (g_snapshot.kde.captured) return;
+  if (!KdeConfigDetected()) return;
+
+  KConfigFile config(KioslavercPath());
+  g_snapshot.kde.captured = true;
+  g_snapshot.kde.proxy_type = config.Read(kKdeProxyGroup, "ProxyType");
+  g_snapshot.kde.http_proxy = config.Read(kKdeProxyGroup, "httpProxy");
+  g_snapshot.kde.https_proxy = config.Read(kKdeProxyGroup, "httpsProxy");
+  g_snapshot.kde.socks_proxy = config.Read(kKdeProxyGroup, "socksProxy");
+  g_snapshot.kde.ftp_proxy = config.Read(kKdeProxyGroup, "ftpProxy");
+  g_snapshot.kde.no_proxy_for = config.Read(kKdeProxyGroup, "NoProxyFor");
+}
+
+bool ApplyKde(const ProxyConfig& config) {
   std::string proxy_url = BuildProxyUrl(config.scheme.empty() ? "http" : config.scheme,
                                         config.host, config.port);
   std::string proxy_socks = BuildProxyUrl(config.scheme.empty() ? "socks5" : config.scheme,
                                           config.host, config.port);
   std::string no_proxy = config.no_proxy.empty() ? "localhost,127.0.0.1,::1" : config.no_proxy;
 
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key ProxyType 1");
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key httpProxy " + QuoteForShell(proxy_url));
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key httpsProxy " + QuoteForShell(proxy_url));
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key socksProxy " + QuoteForShell(proxy_socks));
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key ftpProxy " + QuoteForShell(proxy_url));
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key NoProxyFor " + QuoteForShell(no_proxy));
-  if (CommandExists("qdbus")) {
-    RunCommandQuiet("qdbus org.kde.kded5 /kded org.kde.kded5.loadModule proxy >/dev/null 2>&1");
+  KConfigFile kioslaverc(KioslavercPath());
+  kioslaverc.Write(kKdeProxyGroup, "ProxyType", "1");
+  kioslaverc.Write(kKdeProxyGroup, "httpProxy", proxy_url);
+  kioslaverc.Write(kKdeProxyGroup, "httpsProxy", proxy_url);
+  kioslaverc.Write(kKdeProxyGroup, "socksProxy", proxy_socks);
+  kioslaverc.Write(kKdeProxyGroup, "ftpProxy", proxy_url);
+  kioslaverc.Write(kKdeProxyGroup, "NoProxyFor", no_proxy);
+  if (kioslaverc.dirty() && !kioslaverc.Save()) {
+    return false;
   }
+  NotifyKdeProxyChanged();
   return true;
 }
 
 void RestoreKde() {
-  if (!g_snapshot.kde.captured || !CommandExists("kwriteconfig5")) return;
-
-  auto write_key = [](const std::string& key, const std::string& value) {
-    if (value.empty()) {
-      RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key " + key + " --delete");
-      return;
-    }
-    std::string trimmed = value;
-    while (!trimmed.empty() && (trimmed.back() == '\n' || trimmed.back() == '\r')) {
-      trimmed.pop_back();
-    }
-    RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key " + key + " " + QuoteForShell(trimmed));
-  };
+  if (!g_snapshot.kde.captured) return;
 
-  std::string proxy_type = g_snapshot.kde.proxy_type;
-  while (!proxy_type.empty() && (proxy_type.back() == '\n' || proxy_type.back() == '\r')) {
-    proxy_type.pop_back();
-  }
+  // Snapshots from older builds carry kreadconfig5's trailing newlines.
+  std::string proxy_type = TrimWhitespace(g_snapshot.kde.proxy_type);
   if (proxy_type.empty()) proxy_type = "0";
-  RunCommand("kwriteconfig5 --file kioslaverc --group 'Proxy Settings' --key ProxyType " + proxy_type);
-
-  write_key("httpProxy", g_snapshot.kde.http_proxy);
-  write_key("httpsProxy", g_snapshot.kde.https_proxy);
-  write_key("socksProxy", g_snapshot.kde.socks_proxy);
-  write_key("ftpProxy", g_snapshot.kde.ftp_proxy);
-  write_key("NoProxyFor", g_snapshot.kde.no_proxy_for);
 
-  if (CommandExists("qdbus")) {
-    RunCommandQuiet("qdbus org.kde.kded5 /kded org.kde.kded5.loadModule proxy >/dev/null 2>&1");
+  KConfigFile kioslaverc(KioslavercPath());
+  kioslaverc.Write(kKdeProxyGroup, "ProxyType", proxy_type);
+  kioslaverc.Write(kKdeProxyGroup, "httpProxy", TrimWhitespace(g_snapshot.kde.http_proxy));
+  kioslaverc.Write(kKdeProxyGroup, "httpsProxy", TrimWhitespace(g_snapshot.kde.https_proxy));
+  kioslaverc.Write(kKdeProxyGroup, "socksProxy", TrimWhitespace(g_snapshot.kde.socks_proxy));
+  kioslaverc.Write(kKdeProxyGroup, "ftpProxy", TrimWhitespace(g_snapshot.kde.ftp_proxy));
+  kioslaverc.Write(kKdeProxyGroup, "NoProxyFor", TrimWhitespace(g_snapshot.kde.no_proxy_for));
+  if (!kioslaverc.dirty()) return;
+  if (kioslaverc.Save()) {
+    NotifyKdeProxyChanged();
   }
 }
 
 void CaptureXfce() {
   if (g_snapshot.xfce.captured) return;
-  if (!CommandExists("xfconf-query")) return;
+  if (!Capabilities().xfconf_available) return;
+  g_autoptr(GDBusConnection) bus = XfconfSessionBus();
+  if (!bus) return;
 
-  std::string channel = g_snapshot.xfce.channel.empty() ? DetectXfceChannel() : g_snapshot.xfce.channel;
+  std::string channel = g_snapshot.xfce.channel.empty() ? XfceChannel(bus) : g_snapshot.xfce.channel;
   if (channel.empty()) {
     defyx_core::LogMessage("ProxyManager: XFCE xfconf channel not found; skipping capture");
     return;
   }
 
+  GError* error = nullptr;
+  g_autoptr(GVariant) reply = XfconfCall(bus, "GetAllProperties", g_variant_new("(ss)", channel.c_str(), kXfconfProxyBase),
+                                         G_VARIANT_TYPE("(a{sv})"), &error);
+  // xfconfd reports a channel or base with nothing under it as an error; any
+  // other error, its own included, leaves the old values unknown.
+  bool empty = !reply && (IsXfconfError(error, "ChannelNotFound") || IsXfconfError(error, "PropertyNotFound"));
+  if (!reply && !empty) {
+    // Not knowing the old values is not the same as there being none; a
+    // snapshot that says "unset" would wipe the user's settings on restore.
+    defyx_core::LogMessage(std::string("ProxyManager: XFCE capture failed: ") + error->message);
+    g_error_free(error);
+    return;
+  }
+  g_clear_error(&error);
+  g_autoptr(GVariant) properties = reply ? g_variant_get_child_value(reply, 0) : nullptr;
+
   g_snapshot.xfce.captured = true;
   g_snapshot.xfce.channel = channel;
 
-  auto capture_string = [&](const std::string& property, bool* has_flag, std::string* target) {
-    std::string value;
-    if (XfconfReadProperty(channel, property, &value)) {
-      *has_flag = true;
-      *target = value;
-    } else {
-      *has_flag = false;
-      target->clear();
-    }
+  auto capture_string = [&](const char* property, bool* has_flag, std::string* target) {
+    g_autoptr(GVariant) value = properties ? g_variant_lookup_value(properties, property, nullptr) : nullptr;
+    *has_flag = value != nullptr;
+    *target = value ? XfconfValueToText(value) : std::string();
   };
 
   capture_string("/general/ProxyMode", &g_snapshot.xfce.has_mode, &g_snapshot.xfce.mode);
@@ -1374,67 +1984,75 @@ void CaptureXfce() {
   capture_string("/general/ProxyFtpHost", &g_snapshot.xfce.has_ftp_host, &g_snapshot.xfce.ftp_host);
   capture_string("/general/ProxyFtpPort", &g_snapshot.xfce.has_ftp_port, &g_snapshot.xfce.ftp_port);
 
-  std::string ignore_raw;
-  if (XfconfReadProperty(channel, "/general/ProxyIgnoreHosts", &ignore_raw)) {
-    g_snapshot.xfce.has_ignore_hosts = true;
-    g_snapshot.xfce.ignore_hosts = ParseXfconfList(ignore_raw);
-  } else {
-    g_snapshot.xfce.has_ignore_hosts = false;
-    g_snapshot.xfce.ignore_hosts.clear();
+  g_autoptr(GVariant) ignore_hosts =
+      properties ? g_variant_lookup_value(properties, "/general/ProxyIgnoreHosts", nullptr) : nullptr;
+  g_snapshot.xfce.has_ignore_hosts = ignore_hosts != nullptr;
+  g_snapshot.xfce.ignore_hosts.clear();
+  if (ignore_hosts && g_variant_is_of_type(ignore_hosts, G_VARIANT_TYPE_ARRAY)) {
+    for (gsize i = 0; i < g_variant_n_children(ignore_hosts); ++i) {
+      g_autoptr(GVariant) host = g_variant_get_child_value(ignore_hosts, i);
+      g_snapshot.xfce.ignore_hosts.push_back(XfconfValueToText(host));
+    }
+  } else if (ignore_hosts) {
+    g_snapshot.xfce.ignore_hosts.push_back(XfconfValueToText(ignore_hosts));
   }
 }
 
 bool ApplyXfce(const ProxyConfig& config) {
-  if (!CommandExists("xfconf-query")) return false;
+  if (!g_snapshot.xfce.captured) {
+    // Without a snapshot there would be nothing to put back on restore.
+    defyx_core::LogMessage("ProxyManager: XFCE settings were not captured; skipping apply");
+    return false;
+  }
+  g_autoptr(GDBusConnection) bus = XfconfSessionBus();
+  if (!bus) return false;
 
-  std::string channel = g_snapshot.xfce.channel.empty() ? DetectXfceChannel() : g_snapshot.xfce.channel;
+  std::string channel = g_snapshot.xfce.channel.empty() ? XfceChannel(bus) : g_snapshot.xfce.channel;
   if (channel.empty()) {
     defyx_core::LogMessage("ProxyManager: XFCE xfconf channel not found; cannot apply proxy");
     return false;
   }
   g_snapshot.xfce.channel = channel;
 
-  bool any_applied = false;
-  bool ok = true;
-
-  ok &= XfconfSetValue(channel, "/general/ProxyMode", "string", "manual");
-  ok &= XfconfSetValue(channel, "/general/ProxyUseSame", "bool", "true");
-  ok &= XfconfSetValue(channel, "/general/ProxyHttpHost", "string", config.host);
-  ok &= XfconfSetValue(channel, "/general/ProxyHttpPort", "int", std::to_string(config.port));
-  ok &= XfconfSetValue(channel, "/general/ProxyHttpsHost", "string", config.host);
-  ok &= XfconfSetValue(channel, "/general/ProxyHttpsPort", "int", std::to_string(config.port));
-  ok &= XfconfSetValue(channel, "/general/ProxySocksHost", "string", config.host);
-  ok &= XfconfSetValue(channel, "/general/ProxySocksPort", "int", std::to_string(config.port));
-  ok &= XfconfSetValue(channel, "/general/ProxyFtpHost", "string", config.host);
-  ok &= XfconfSetValue(channel, "/general/ProxyFtpPort", "int", std::to_string(config.port));
-
-  std::vector<std::string> ignore_hosts = BuildNoProxyList(config.no_proxy);
-  ok &= XfconfSetStringList(channel, "/general/ProxyIgnoreHosts", ignore_hosts);
-
-  any_applied = ok;
+  XfconfBatch batch(bus, channel);
+  batch.Set("/general/ProxyMode", g_variant_new_string("manual"));
+  batch.Set("/general/ProxyUseSame", g_variant_new_boolean(TRUE));
+  batch.Set("/general/ProxyHttpHost", g_variant_new_string(config.host.c_str()));
+  batch.Set("/general/ProxyHttpPort", g_variant_new_int32(config.port));
+  batch.Set("/general/ProxyHttpsHost", g_variant_new_string(config.host.c_str()));
+  batch.Set("/general/ProxyHttpsPort", g_variant_new_int32(config.port));
+  batch.Set("/general/ProxySocksHost", g_variant_new_string(config.host.c_str()));
+  batch.Set("/general/ProxySocksPort", g_variant_new_int32(config.port));
+  batch.Set("/general/ProxyFtpHost", g_variant_new_string(config.host.c_str()));
+  batch.Set("/general/ProxyFtpPort", g_variant_new_int32(config.port));
+  batch.SetStringList("/general/ProxyIgnoreHosts", BuildNoProxyList(config.no_proxy));
+
+  bool ok = batch.Commit();
   if (!ok) {
     defyx_core::LogMessage("ProxyManager: failed to update all XFCE proxy keys");
   }
-
-  return any_applied;
+  return ok;
 }
 
 void RestoreXfce() {
   if (!g_snapshot.xfce.captured) return;
-  if (!CommandExists("xfconf-query")) return;
+  if (!Capabilities().xfconf_available) return;
+  g_autoptr(GDBusConnection) bus = XfconfSessionBus();
+  if (!bus) return;
 
-  std::string channel = g_snapshot.xfce.channel.empty() ? DetectXfceChannel() : g_snapshot.xfce.channel;
+  std::string channel = g_snapshot.xfce.channel.empty() ? XfceChannel(bus) : g_snapshot.xfce.channel;
   if (channel.empty()) {
     defyx_core::LogMessage("ProxyManager: XFCE xfconf channel not found; cannot restore snapshot");
     return;
   }
   g_snapshot.xfce.channel = channel;
 
-  auto restore_value = [&](const std::string& property, bool has_value, const std::string& value, const std::string& type) {
+  XfconfBatch batch(bus, channel);
+  auto restore_value = [&](const char* property, bool has_value, const std::string& value, const std::string& type) {
     if (has_value) {
-      XfconfSetValue(channel, property, type, value);
+      batch.Set(property, XfconfValueFromText(type, value));
     } else {
-      XfconfResetProperty(channel, property);
+      batch.Reset(property);
     }
   };
 
@@ -1450,110 +2068,330 @@ void RestoreXfce() {
   restore_value("/general/ProxyFtpPort", g_snapshot.xfce.has_ftp_port, g_snapshot.xfce.ftp_port, "int");
 
   if (g_snapshot.xfce.has_ignore_hosts) {
-    XfconfSetStringList(channel, "/general/ProxyIgnoreHosts", g_snapshot.xfce.ignore_hosts);
+    batch.SetStringList("/general/ProxyIgnoreHosts", g_snapshot.xfce.ignore_hosts);
   } else {
-    XfconfResetProperty(channel, "/general/ProxyIgnoreHosts");
+    batch.Reset("/general/ProxyIgnoreHosts");
+  }
+  if (!batch.Commit()) {
+    defyx_core::LogMessage("ProxyManager: failed to restore all XFCE proxy keys");
+  }
+}
+
+// NetworkManager over D-Bus. Proxy settings live in each connection's "proxy"
+// group; a connection is read with one GetSettings, written back with one
+// Update2, and the active device picks the change up through Reapply, which
+// keeps the link up where `nmcli connection up` would bounce it.
+constexpr const char* kNmService = "org.freedesktop.NetworkManager";
+constexpr const char* kNmPath = "/org/freedesktop/NetworkManager";
+constexpr const char* kNmSettingsPath = "/org/freedesktop/NetworkManager/Settings";
+constexpr int kNmCallTimeoutMs = 3000;
+constexpr guint32 kNmUpdateToDisk = 0x1;  // NM_SETTINGS_UPDATE2_FLAG_TO_DISK
+
+struct NmActiveConnection {
+  std::string id;
+  std::string settings_path;
+  std::vector<std::string> devices;
+};
+
+GDBusConnection* NmSystemBus() {
+  GError* error = nullptr;
+  GDBusConnection* bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
+  if (!bus) {
+    defyx_core::LogMessage(std::string("ProxyManager: system bus unavailable: ") + error->message);
+    g_error_free(error);
+  }
+  return bus;
+}
+
+// Returns the reply, or null after logging the error.
+GVariant* NmCall(GDBusConnection* bus,
+                 const std::string& path,
+                 const char* interface,
+                 const char* method,
+                 GVariant* parameters,
+                 const GVariantType* reply_type) {
+  GError* error = nullptr;
+  GVariant* reply = g_dbus_connection_call_sync(bus, kNmService, path.c_str(), interface, method, parameters, reply_type,
+                                                G_DBUS_CALL_FLAGS_NO_AUTO_START, kNmCallTimeoutMs, nullptr, &error);
+  if (!reply) {
+    defyx_core::LogMessage(std::string("ProxyManager: NetworkManager ") + method + " failed: " + error->message);
+    g_error_free(error);
+  }
+  return reply;
+}
+
+bool NetworkManagerRunning() {
+  g_autoptr(GDBusConnection) bus = NmSystemBus();
+  if (!bus) return false;
+  return DBusNameHasOwner(bus, kNmService);
+}
+
+std::vector<std::string> NmObjectPaths(GVariant* paths) {
+  std::vector<std::string> result;
+  if (!paths || !g_variant_is_of_type(paths, G_VARIANT_TYPE_OBJECT_PATH_ARRAY)) return result;
+  for (gsize i = 0; i < g_variant_n_children(paths); ++i) {
+    g_autoptr(GVariant) path = g_variant_get_child_value(paths, i);
+    result.push_back(g_variant_get_string(path, nullptr));
+  }
+  return result;
+}
+
+std::vector<NmActiveConnection> ListNmActiveConnections(GDBusConnection* bus) {
+  std::vector<NmActiveConnection> result;
+  g_autoptr(GVariant) reply = NmCall(bus, kNmPath, "org.freedesktop.DBus.Properties", "Get",
+                                     g_variant_new("(ss)", kNmService, "ActiveConnections"), G_VARIANT_TYPE("(v)"));
+  if (!reply) return result;
+  g_autoptr(GVariant) boxed = g_variant_get_child_value(reply, 0);
+  g_autoptr(GVariant) paths = g_variant_get_variant(boxed);
+
+  for (const auto& path : NmObjectPaths(paths)) {
+    g_autoptr(GVariant) props_reply =
+        NmCall(bus, path, "org.freedesktop.DBus.Properties", "GetAll",
+               g_variant_new("(s)", "org.freedesktop.NetworkManager.Connection.Active"), G_VARIANT_TYPE("(a{sv})"));
+    if (!props_reply) continue;
+    g_autoptr(GVariant) props = g_variant_get_child_value(props_reply, 0);
+    g_autoptr(GVariant) id = g_variant_lookup_value(props, "Id", G_VARIANT_TYPE_STRING);
+    g_autoptr(GVariant) connection = g_variant_lookup_value(props, "Connection", G_VARIANT_TYPE_OBJECT_PATH);
+    g_autoptr(GVariant) devices = g_variant_lookup_value(props, "Devices", G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+    if (!id || !connection) continue;
+
+    NmActiveConnection active;
+    active.id = g_variant_get_string(id, nullptr);
+    active.settings_path = g_variant_get_string(connection, nullptr);
+    active.devices = NmObjectPaths(devices);
+    result.push_back(std::move(active));
+  }
+  return result;
+}
+
+// The connection's settings (a{sa{sv}}), without secrets.
+GVariant* GetNmSettings(GDBusConnection* bus, const std::string& settings_path) {
+  g_autoptr(GVariant) reply = NmCall(bus, settings_path, "org.freedesktop.NetworkManager.Settings.Connection",
+                                     "GetSettings", nullptr, G_VARIANT_TYPE("(a{sa{sv}})"));
+  return reply ? g_variant_get_child_value(reply, 0) : nullptr;
+}
+
+// Settings path of the saved connection called |id|, for restoring a
+// connection that is no longer active.
+std::string FindNmSettingsPath(GDBusConnection* bus, const std::string& id) {
+  g_autoptr(GVariant) reply = NmCall(bus, kNmSettingsPath, "org.freedesktop.NetworkManager.Settings",
+                                     "ListConnections", nullptr, G_VARIANT_TYPE("(ao)"));
+  if (!reply) return "";
+  g_autoptr(GVariant) paths = g_variant_get_child_value(reply, 0);
+  for (const auto& path : NmObjectPaths(paths)) {
+    g_autoptr(GVariant) settings = GetNmSettings(bus, path);
+    if (!settings) continue;
+    g_autoptr(GVariant) connection = g_variant_lookup_value(settings, "connection", G_VARIANT_TYPE_VARDICT);
+    g_autoptr(GVariant) value = connection ? g_variant_lookup_value(connection, "id", G_VARIANT_TYPE_STRING) : nullptr;
+    if (value && id == g_variant_get_string(value, nullptr)) {
+      return path;
+    }
+  }
+  return "";
+}
+
+std::string NmProxyString(GVariant* proxy, const char* key) {
+  g_autoptr(GVariant) value = proxy ? g_variant_lookup_value(proxy, key, G_VARIANT_TYPE_STRING) : nullptr;
+  return value ? g_variant_get_string(value, nullptr) : "";
+}
+
+// proxy.method is an int on the bus and a name in nmcli and the snapshot.
+// Builds that carry manual proxies number it after none and auto.
+std::string NmProxyMethodName(gint32 method) {
+  switch (method) {
+    case 0: return "none";
+    case 1: return "auto";
+    case 2: return "manual";
+    default: return std::to_string(method);
+  }
+}
+
+gint32 NmProxyMethodValue(const std::string& name) {
+  if (name == "auto") return 1;
+  if (name == "manual") return 2;
+  char* end = nullptr;
+  long value = std::strtol(name.c_str(), &end, 10);
+  return !name.empty() && *end == '\0' ? static_cast<gint32>(value) : 0;
+}
+
+struct NmProxyValues {
+  gint32 method = 0;
+  std::string http;
+  std::string https;
+  std::string socks;
+};
+
+// |settings| with the proxy group's method/http/https/socks replaced; other
+// proxy keys and every other group are passed through. Empty strings are left
+// out, which resets them to NM's default.
+GVariant* WithNmProxy(GVariant* settings, const NmProxyValues& values) {
+  GVariantBuilder proxy;
+  g_variant_builder_init(&proxy, G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GVariant) current = g_variant_lookup_value(settings, "proxy", G_VARIANT_TYPE_VARDICT);
+  if (current) {
+    for (gsize i = 0; i < g_variant_n_children(current); ++i) {
+      g_autoptr(GVariant) entry = g_variant_get_child_value(current, i);
+      g_autoptr(GVariant) key = g_variant_get_child_value(entry, 0);
+      std::string name = g_variant_get_string(key, nullptr);
+      if (name == "method" || name == "http" || name == "https" || name == "socks") continue;
+      g_variant_builder_add_value(&proxy, entry);
+    }
+  }
+  g_variant_builder_add(&proxy, "{sv}", "method", g_variant_new_int32(values.method));
+  auto add_string = [&](const char* key, const std::string& value) {
+    if (!value.empty()) g_variant_builder_add(&proxy, "{sv}", key, g_variant_new_string(value.c_str()));
+  };
+  add_string("http", values.http);
+  add_string("https", values.https);
+  add_string("socks", values.socks);
+
+  GVariantBuilder result;
+  g_variant_builder_init(&result, G_VARIANT_TYPE("a{sa{sv}}"));
+  for (gsize i = 0; i < g_variant_n_children(settings); ++i) {
+    g_autoptr(GVariant) entry = g_variant_get_child_value(settings, i);
+    g_autoptr(GVariant) key = g_variant_get_child_value(entry, 0);
+    if (std::strcmp(g_variant_get_string(key, nullptr), "proxy") == 0) continue;
+    g_variant_builder_add_value(&result, entry);
+  }
+  g_variant_builder_add(&result, "{sa{sv}}", "proxy", &proxy);
+  return g_variant_builder_end(&result);
+}
+
+// One Update2 for the saved connection, then Reapply on each device it is
+// active on. Secrets are not sent; NetworkManager keeps the stored ones when
+// an update carries none.
+bool UpdateNmProxy(GDBusConnection* bus,
+                   const std::string& settings_path,
+                   const std::vector<std::string>& devices,
+                   const NmProxyValues& values) {
+  g_autoptr(GVariant) settings = GetNmSettings(bus, settings_path);
+  if (!settings) return false;
+
+  GVariant* updated = WithNmProxy(settings, values);
+  g_autoptr(GVariant) reply = NmCall(bus, settings_path, "org.freedesktop.NetworkManager.Settings.Connection",
+                                     "Update2", g_variant_new("(@a{sa{sv}}ua{sv})", updated, kNmUpdateToDisk, nullptr),
+                                     G_VARIANT_TYPE("(a{sv})"));
+  if (!reply) return false;
+
+  for (const auto& device : devices) {
+    // An empty connection reapplies what was just saved. If the device can't
+    // take the change live it applies on the next activation; never bounce
+    // the link here.
+    GVariant* reapplied = NmCall(bus, device, "org.freedesktop.NetworkManager.Device", "Reapply",
+                                 g_variant_new("(a{sa{sv}}tu)", nullptr, static_cast<guint64>(0), 0u), nullptr);
+    if (reapplied) g_variant_unref(reapplied);
+  }
+  return true;
+}
+
+const NmActiveConnection* FindNmActive(const std::vector<NmActiveConnection>& active, const std::string& id) {
+  for (const auto& connection : active) {
+    if (connection.id == id) return &connection;
   }
+  return nullptr;
 }
 
 void CaptureNM() {
   if (g_snapshot.nm.captured) return;
-  if (!CommandExists("nmcli")) return;
-
-  CommandResult res = RunCommand("nmcli -t -f NAME connection show --active");
-  if (res.exit_code != 0) return;
+  g_autoptr(GDBusConnection) bus = NmSystemBus();
+  if (!bus) return;
 
+  auto active = ListNmActiveConnections(bus);
   g_snapshot.nm.captured = true;
   g_snapshot.nm.connections.clear();
 
-  std::stringstream ss(res.output);
-  std::string line;
-  while (std::getline(ss, line)) {
-    if (line.empty()) continue;
+  for (const auto& connection : active) {
     NmConnectionSnapshot snapshot;
-    snapshot.name = line;
-    std::string quoted = QuoteForShell(line);
-    snapshot.method = RunCommand("nmcli -g proxy.method connection show " + quoted + " 2>/dev/null").output;
-
-    CommandResult show_output = RunCommandQuiet("nmcli connection show " + quoted + " 2>/dev/null");
-    if (show_output.exit_code == 0 &&
-        (show_output.output.find("proxy.http") != std::string::npos ||
-         show_output.output.find("proxy.https") != std::string::npos ||
-         show_output.output.find("proxy.socks") != std::string::npos)) {
-      snapshot.manual_supported = true;
-      snapshot.http = RunCommand("nmcli -g proxy.http connection show " + quoted + " 2>/dev/null").output;
-      snapshot.https = RunCommand("nmcli -g proxy.https connection show " + quoted + " 2>/dev/null").output;
-      snapshot.socks = RunCommand("nmcli -g proxy.socks connection show " + quoted + " 2>/dev/null").output;
-    }
+    snapshot.name = connection.id;
+    g_autoptr(GVariant) settings = GetNmSettings(bus, connection.settings_path);
+    g_autoptr(GVariant) proxy = settings ? g_variant_lookup_value(settings, "proxy", G_VARIANT_TYPE_VARDICT) : nullptr;
+    g_autoptr(GVariant) method = proxy ? g_variant_lookup_value(proxy, "method", G_VARIANT_TYPE_INT32) : nullptr;
+    snapshot.method = NmProxyMethodName(method ? g_variant_get_int32(method) : 0);
+    // GetSettings leaves out properties at their default, so an absent key is
+    // simply unset and restores as such.
+    snapshot.http = NmProxyString(proxy, "http");
+    snapshot.https = NmProxyString(proxy, "https");
+    snapshot.socks = NmProxyString(proxy, "socks");
     g_snapshot.nm.connections.push_back(snapshot);
   }
 }
 
 bool ApplyNM(const ProxyConfig& config) {
-  if (!CommandExists("nmcli")) return false;
+  g_autoptr(GDBusConnection) bus = NmSystemBus();
+  if (!bus) return false;
   std::string proxy_url = BuildProxyUrl(config.scheme.empty() ? "http" : config.scheme,
                                         config.host, config.port);
   std::string socks_url = BuildProxyUrl(config.scheme.empty() ? "socks5" : config.scheme,
                                         config.host, config.port);
 
+  // Whether a build supports manual proxies can't be read off GetSettings,
+  // which omits unset properties. Stock NetworkManager only knows the none and
+  // auto (PAC) methods and rejects an update that asks for manual, leaving the
+  // connection as it was, so support is found out by trying. The snapshot on
+  // disk marks each connection before it is tried, so a restore after a crash
+  // still covers it.
+  auto active = ListNmActiveConnections(bus);
+  std::vector<std::pair<NmConnectionSnapshot*, const NmActiveConnection*>> targets;
+  for (auto& conn_snapshot : g_snapshot.nm.connections) {
+    if (conn_snapshot.name.empty()) continue;
+    const NmActiveConnection* connection = FindNmActive(active, conn_snapshot.name);
+    if (!connection) continue;
+    conn_snapshot.manual_supported = true;
+    targets.emplace_back(&conn_snapshot, connection);
+  }
+  if (targets.empty()) return false;
+  SaveSnapshotToDisk(g_snapshot);
+
+  NmProxyValues values;
+  values.method = NmProxyMethodValue("manual");
+  values.http = proxy_url;
+  values.https = proxy_url;
+  values.socks = socks_url;
   bool applied = false;
-  for (size_t i = 0; i < g_snapshot.nm.connections.size(); ++i) {
-    const NmConnectionSnapshot& conn_snapshot = g_snapshot.nm.connections[i];
-    const std::string& name = conn_snapshot.name;
-    if (name.empty()) continue;
-    std::string quoted = QuoteForShell(name);
-    if (!conn_snapshot.manual_supported) {
-      defyx_core::LogMessage("ProxyManager: skipping NetworkManager proxy update for " + name + " (proxy.http unsupported)");
-      continue;
-    }
-
-    CommandResult method_result = RunCommand("nmcli connection modify " + quoted + " proxy.method manual >/dev/null 2>&1");
-    if (method_result.exit_code != 0) {
-      defyx_core::LogMessage("ProxyManager: skipping NetworkManager proxy update for " + name + " (manual method unavailable)");
+  bool rejected = false;
+  for (const auto& target : targets) {
+    if (!UpdateNmProxy(bus, target.second->settings_path, target.second->devices, values)) {
+      defyx_core::LogMessage("ProxyManager: skipping NetworkManager proxy update for " + target.first->name +
+                             " (manual proxy rejected)");
+      target.first->manual_supported = false;
+      rejected = true;
       continue;
     }
-
-    RunCommand("nmcli connection modify " + quoted + " proxy.http " + QuoteForShell(proxy_url) + " >/dev/null 2>&1");
-    RunCommand("nmcli connection modify " + quoted + " proxy.https " + QuoteForShell(proxy_url) + " >/dev/null 2>&1");
-    RunCommand("nmcli connection modify " + quoted + " proxy.socks " + QuoteForShell(socks_url) + " >/dev/null 2>&1");
-    RunCommand("nmcli connection up " + quoted + " >/dev/null 2>&1");
     applied = true;
   }
+  if (rejected) SaveSnapshotToDisk(g_snapshot);
 
   return applied;
 }
 
 void RestoreNM() {
-  if (!g_snapshot.nm.captured || !CommandExists("nmcli")) return;
+  if (!g_snapshot.nm.captured) return;
+  g_autoptr(GDBusConnection) bus = NmSystemBus();
+  if (!bus) return;
+
+  auto active = ListNmActiveConnections(bus);
   for (size_t i = 0; i < g_snapshot.nm.connections.size(); ++i) {
     const NmConnectionSnapshot& conn = g_snapshot.nm.connections[i];
     if (conn.name.empty()) continue;
     if (!conn.manual_supported) continue;
-    std::string quoted = QuoteForShell(conn.name);
 
-    std::string method = conn.method;
-    while (!method.empty() && (method.back() == '\n' || method.back() == '\r')) {
-      method.pop_back();
+    // Snapshots from older builds carry nmcli's trailing newlines.
+    NmProxyValues values;
+    std::string method = TrimWhitespace(conn.method);
+    values.method = NmProxyMethodValue(method.empty() ? "none" : method);
+    values.http = TrimWhitespace(conn.http);
+    values.https = TrimWhitespace(conn.https);
+    values.socks = TrimWhitespace(conn.socks);
+
+    const NmActiveConnection* connection = FindNmActive(active, conn.name);
+    if (connection) {
+      UpdateNmProxy(bus, connection->settings_path, connection->devices, values);
+      continue;
+    }
+    std::string settings_path = FindNmSettingsPath(bus, conn.name);
+    if (!settings_path.empty()) {
+      UpdateNmProxy(bus, settings_path, {}, values);
     }
-    if (method.empty()) method = "none";
-    RunCommand("nmcli connection modify " + quoted + " proxy.method " + method + " >/dev/null 2>&1");
-
-    auto restore_field = [&](const std::string& key, const std::string& value) {
-      std::string trimmed = value;
-      while (!trimmed.empty() && (trimmed.back() == '\n' || trimmed.back() == '\r')) {
-        trimmed.pop_back();
-      }
-      if (trimmed.empty()) {
-        RunCommand("nmcli connection modify " + quoted + " " + key + " '' >/dev/null 2>&1");
-      } else {
-        RunCommand("nmcli connection modify " + quoted + " " + key + " " + QuoteForShell(trimmed) + " >/dev/null 2>&1");
-      }
-    };
-
-    restore_field("proxy.http", conn.http);
-    restore_field("proxy.https", conn.https);
-    restore_field("proxy.socks", conn.socks);
-    RunCommand("nmcli connection up " + quoted + " >/dev/null 2>&1");
   }
 }
 
@@ -1568,19 +2406,24 @@ void CaptureAll() {
 ApplyResults ApplyAll(const ProxyConfig& config, const ProxyBackends& backends) {
   ApplyResults results;
   if (backends.use_env) {
+    connect_trace::Span span("proxy.env", "proxy");
     ApplyEnv(config);
     results.env_applied = true;
   }
   if (backends.use_gsettings) {
+    connect_trace::Span span("proxy.gsettings", "proxy");
     results.gsettings_applied = ApplyGsettings(config);
   }
   if (backends.use_xfconf) {
+    connect_trace::Span span("proxy.xfce", "proxy");
     results.xfce_applied = ApplyXfce(config);
   }
   if (backends.use_kde) {
+    connect_trace::Span span("proxy.kde", "proxy");
     results.kde_applied = ApplyKde(config);
   }
   if (backends.use_nm) {
+    connect_trace::Span span("proxy.network-manager", "proxy");
     results.nm_applied = ApplyNM(config);
   }
   return results;
@@ -1597,13 +2440,19 @@ void RestoreAll() {
 }  // namespace
 
 bool ApplySystemProxy(const ProxyConfig& config) {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("proxy::ApplySystemProxy");
+  connect_trace::Span span("proxy.ApplySystemProxy", "proxy");
   std::lock_guard<std::mutex> lock(g_mutex);
   if (config.host.empty() || config.port <= 0) {
     defyx_core::LogMessage("ProxyManager: invalid proxy configuration");
     return false;
   }
 
-  ProxyBackends backends = DetermineProxyBackends();
+  ProxyBackends backends;
+  {
+    connect_trace::Span detect("proxy.detect", "proxy");
+    backends = DetermineProxyBackends();
+  }
   std::vector<std::string> backend_names;
   if (backends.use_env) backend_names.push_back("env");
   if (backends.use_gsettings) backend_names.push_back("gsettings");
@@ -1614,6 +2463,7 @@ bool ApplySystemProxy(const ProxyConfig& config) {
   defyx_core::LogMessage("ProxyManager: desktop detection -> " + JoinStrings(backend_names, ", "));
 
   if (!g_applied) {
+    connect_trace::Span capture("proxy.capture", "proxy");
     CaptureAll();
     SaveSnapshotToDisk(g_snapshot);
   }
@@ -1647,6 +2497,8 @@ bool ApplySystemProxy(const ProxyConfig& config) {
 }
 
 void ResetSystemProxy() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("proxy::ResetSystemProxy");
+  connect_trace::Span span("proxy.ResetSystemProxy", "proxy");
   std::lock_guard<std::mutex> lock(g_mutex);
   EnsureSnapshotPath();
   if (!g_applied && !std::filesystem::exists(g_snapshot_path)) {
@@ -1669,7 +2521,12 @@ void ResetSystemProxy() {
 }
 
 void RestorePendingSnapshot() {
+  DEFYX_ASSERT_OFF_MAIN_THREAD("proxy::RestorePendingSnapshot");
   std::lock_guard<std::mutex> lock(g_mutex);
+  // This runs on an executor lane and can lose the race to a setSystemProxy
+  // from another handler. The snapshot on disk is then the one that call just
+  // wrote, and restoring it would take the live proxy down.
+  if (g_applied) return;
   EnsureSnapshotPath();
   Snapshot snapshot_from_disk;
   if (!LoadSnapshotFromDisk(&snapshot_from_disk)) {
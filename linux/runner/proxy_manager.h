@@ -18,7 +18,8 @@ bool ApplySystemProxy(const ProxyConfig& config);
 // Restores the previously captured system proxy configuration, if any.
 void ResetSystemProxy();
 
-// If a previous run left a snapshot on disk, attempt to restore it.
+// If a previous run left a snapshot on disk, attempt to restore it. Does
+// nothing once ApplySystemProxy has run in this process.
 void RestorePendingSnapshot();
 
 }  // namespace proxy
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <utility>
+
+// Collapses concurrent calls to the same operation into one: the first caller
+// runs it, callers arriving while it is in flight wait for and share its
+// result. A result younger than the minimum interval is handed out again
+// without running the operation at all.
+template <typename T>
+class SingleFlight {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit SingleFlight(Clock::duration min_interval = Clock::duration::zero())
+      : min_interval_(min_interval) {}
+
+  void set_min_interval(Clock::duration min_interval) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    min_interval_ = min_interval;
+  }
+
+  template <typename Fn>
+  T Do(Fn&& fn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (has_last_ && Clock::now() - last_at_ < min_interval_) {
+      recent_.fetch_add(1, std::memory_order_relaxed);
+      return last_;
+    }
+    if (in_flight_.valid()) {
+      std::shared_future<T> pending = in_flight_;
+      lock.unlock();
+      joined_.fetch_add(1, std::memory_order_relaxed);
+      return pending.get();
+    }
+
+    std::promise<T> promise;
+    in_flight_ = promise.get_future().share();
+    lock.unlock();
+    executed_.fetch_add(1, std::memory_order_relaxed);
+
+    T value;
+    try {
+      value = fn();
+    } catch (...) {
+      lock.lock();
+      in_flight_ = std::shared_future<T>();
+      lock.unlock();
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+
+    lock.lock();
+    last_ = value;
+    last_at_ = Clock::now();
+    has_last_ = true;
+    in_flight_ = std::shared_future<T>();
+    lock.unlock();
+    promise.set_value(value);
+    return value;
+  }
+
+  // Forgets the last result so the next call runs the operation. A call that
+  // is already in flight still completes for its waiters.
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    has_last_ = false;
+  }
+
+  uint64_t executed() const { return executed_.load(std::memory_order_relaxed); }
+  uint64_t joined() const { return joined_.load(std::memory_order_relaxed); }
+  uint64_t recent() const { return recent_.load(std::memory_order_relaxed); }
+
+ private:
+  std::mutex mutex_;
+  Clock::duration min_interval_;
+  std::shared_future<T> in_flight_;
+  T last_{};
+  Clock::time_point last_at_;
+  bool has_last_ = false;
+
+  std::atomic<uint64_t> executed_{0};
+  std::atomic<uint64_t> joined_{0};
+  std::atomic<uint64_t> recent_{0};
+};
@@ -3,10 +3,16 @@
 #include <thread>
 #include <chrono>
 #include <cstring>
-#include <filesystem>
-#include <system_error>
+#include <string_view>
 
+#include "cache_manager.h"
+#include "connect_trace.h"
+#include "connection_event.h"
 #include "defyx_core.h"
+#include "defyx_core_cache.h"
+#include "deadline_reply.h"
+#include "defyx_logger.h"
+#include "main_thread.h"
 #include "proxy_manager.h"
 #include "system_tray.h"
 
@@ -32,6 +38,20 @@ namespace
         return {};
     }
 
+    int64_t LookupInt(FlValue *map, const char *key, int64_t fallback)
+    {
+        if (map == nullptr || fl_value_get_type(map) != FL_VALUE_TYPE_MAP)
+        {
+            return fallback;
+        }
+        FlValue *value = fl_value_lookup_string(map, key);
+        if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT)
+        {
+            return fl_value_get_int(value);
+        }
+        return fallback;
+    }
+
     void FinishWithResponse(FlMethodCall *method_call, FlMethodResponse *response)
     {
         if (method_call == nullptr || response == nullptr)
@@ -59,9 +79,12 @@ namespace
         FinishWithSuccess(method_call, fl_value_new_bool(value));
     }
 
-    void FinishWithString(FlMethodCall *method_call, const std::string &value)
+    // Copies |value| into the reply exactly once; callers can pass a
+    // defyx_core::CoreString view straight through.
+    void FinishWithString(FlMethodCall *method_call, std::string_view value)
     {
-        FinishWithSuccess(method_call, fl_value_new_string(value.c_str()));
+        g_autoptr(FlValue) result = fl_value_new_string_sized(value.data(), value.size());
+        FinishWithSuccess(method_call, result);
     }
 
     void FinishWithInt(FlMethodCall *method_call, int64_t value)
@@ -90,84 +113,19 @@ namespace
         FinishWithResponse(method_call, response);
     }
 
-    struct AsyncPingTask
-    {
-        FlMethodCall *method_call;
+    // Deadline outcomes per method, reported by getNativeStats.
+    DeadlineCounters g_ping_deadlines;
+    DeadlineCounters g_flag_deadlines;
 
-        AsyncPingTask(FlMethodCall *call) : method_call(call)
-        {
-            g_object_ref(method_call);
-        }
-
-        ~AsyncPingTask()
-        {
-            if (method_call)
-            {
-                g_object_unref(method_call);
-            }
-        }
-    };
-
-    struct AsyncFlagTask
-    {
-        FlMethodCall *method_call;
-
-        AsyncFlagTask(FlMethodCall *call) : method_call(call)
-        {
-            g_object_ref(method_call);
-        }
-
-        ~AsyncFlagTask()
-        {
-            if (method_call)
-            {
-                g_object_unref(method_call);
-            }
-        }
-    };
-
-    gboolean DeliverPingResult(gpointer user_data)
-    {
-        auto *data = static_cast<std::pair<AsyncPingTask *, int> *>(user_data);
-        auto *task = data->first;
-        int ping_result = data->second;
-
-        FinishWithInt(task->method_call, static_cast<int64_t>(ping_result));
-
-        delete task;
-        delete data;
-        return FALSE;
-    }
-
-    gboolean DeliverFlagResult(gpointer user_data)
-    {
-        auto *data = static_cast<std::pair<AsyncFlagTask *, std::string> *>(user_data);
-        auto *task = data->first;
-        std::string flag_result = data->second;
-
-        FinishWithString(task->method_call, flag_result);
-
-        delete task;
-        delete data;
-        return FALSE;
-    }
-
-    void ExecutePingInBackground(AsyncPingTask *task)
+    void MeasurePingInBackground(std::shared_ptr<DeadlineReply> reply)
     {
         int ping_result = DEFAULT_PING;
 
         try
         {
-            auto start_time = std::chrono::steady_clock::now();
-            long long core_ping = defyx_core::MeasurePing();
-            auto end_time = std::chrono::steady_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+            long long core_ping = defyx_core::CoalescedMeasurePing();
 
-            if (duration.count() > PING_TIMEOUT_MS)
-            {
-                ping_result = DEFAULT_PING;
-            }
-            else if (core_ping <= 0)
+            if (core_ping <= 0)
             {
                 ping_result = DEFAULT_PING;
             }
@@ -185,32 +143,24 @@ namespace
             ping_result = DEFAULT_PING;
         }
 
-        auto *result_data = new std::pair<AsyncPingTask *, int>(task, ping_result);
-        g_idle_add(DeliverPingResult, result_data);
+        DeadlineReply::Complete(std::move(reply), fl_value_new_int(ping_result));
     }
 
-    void ExecuteFlagInBackground(AsyncFlagTask *task)
+    void GetFlagInBackground(std::shared_ptr<DeadlineReply> reply)
     {
         std::string flag_result = DEFAULT_FLAG;
 
         try
         {
-            auto start_time = std::chrono::steady_clock::now();
-            std::string core_flag = defyx_core::GetFlag();
-            auto end_time = std::chrono::steady_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+            defyx_core::CoreString core_flag = defyx_core::CachedGetFlag();
 
-            if (duration.count() > FLAG_TIMEOUT_MS)
-            {
-                flag_result = DEFAULT_FLAG;
-            }
-            else if (core_flag.empty() || core_flag.length() > 10)
+            if (core_flag.empty() || core_flag.size() > 10)
             {
                 flag_result = DEFAULT_FLAG;
             }
             else
             {
-                flag_result = core_flag;
+                flag_result = core_flag.str();
             }
         }
         catch (...)
@@ -218,8 +168,16 @@ namespace
             flag_result = DEFAULT_FLAG;
         }
 
-        auto *result_data = new std::pair<AsyncFlagTask *, std::string>(task, flag_result);
-        g_idle_add(DeliverFlagResult, result_data);
+        DeadlineReply::Complete(std::move(reply), fl_value_new_string(flag_result.c_str()));
+    }
+
+    FlValue *NewDeadlineStats(const DeadlineCounters &counters)
+    {
+        FlValue *item = fl_value_new_map();
+        fl_value_set_string_take(item, "onTime", fl_value_new_int(static_cast<int64_t>(counters.on_time.load())));
+        fl_value_set_string_take(item, "missed", fl_value_new_int(static_cast<int64_t>(counters.missed.load())));
+        fl_value_set_string_take(item, "late", fl_value_new_int(static_cast<int64_t>(counters.late.load())));
+        return item;
     }
 
 } // namespace
@@ -229,7 +187,6 @@ VPNChannelHandler::VPNChannelHandler(FlBinaryMessenger *messenger,
                                      SystemTray *system_tray)
     : messenger_(messenger),
       system_tray_(system_tray),
-      vpn_status_("disconnected"),
       method_channel_(nullptr),
       status_channel_(nullptr),
       progress_channel_(nullptr),
@@ -239,6 +196,11 @@ VPNChannelHandler::VPNChannelHandler(FlBinaryMessenger *messenger,
 VPNChannelHandler::~VPNChannelHandler()
 {
     is_active_ = false;
+    alive_.reset();
+    defyx_core::RegisterProgressHandler(nullptr);
+    defyx_core::SetResultCacheRefreshPoster(nullptr);
+    executor_.Shutdown();
+    progress_pipeline_.reset();
 
     if (method_channel_)
     {
@@ -259,6 +221,10 @@ VPNChannelHandler::~VPNChannelHandler()
 
 void VPNChannelHandler::SetupChannels()
 {
+    // Stale cached lookups refresh on the background lane, never on a thread
+    // of their own.
+    defyx_core::SetResultCacheRefreshPoster([this](std::function<void()> task)
+                                            { return executor_.Post(NativeExecutor::Lane::kBackground, std::move(task)); });
     SetupStatusChannel();
     SetupProgressChannel();
     SetupMethodChannel();
@@ -275,6 +241,10 @@ void VPNChannelHandler::SetupStatusChannel()
 
 void VPNChannelHandler::SetupProgressChannel()
 {
+    progress_pipeline_ = std::make_unique<ProgressPipeline>(
+        [this](std::vector<std::string> &batch)
+        { HandleProgressBatch(batch); });
+
     g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
     progress_channel_ = fl_event_channel_new(
         messenger_, "com.defyx.progress_events", FL_METHOD_CODEC(codec));
@@ -298,7 +268,8 @@ FlMethodErrorResponse *VPNChannelHandler::StatusListen(FlEventChannel *channel,
     VPNChannelHandler *self = static_cast<VPNChannelHandler *>(user_data);
     self->status_listening_ = true;
     defyx_core::LogMessage("VPNChannelHandler: Status event stream - OnListen");
-    self->SendStatus("disconnected");
+    // A new listener gets the real state, not an assumed "disconnected".
+    self->SendStatus();
     return nullptr;
 }
 
@@ -322,13 +293,7 @@ FlMethodErrorResponse *VPNChannelHandler::ProgressListen(FlEventChannel *channel
     defyx_core::RegisterProgressHandler([self](std::string msg)
                                         {
     if (!self->is_active_) return;
-    
-    g_idle_add([](gpointer data) -> gboolean {
-      auto* msg_data = static_cast<std::pair<VPNChannelHandler*, std::string>*>(data);
-      msg_data->first->HandleProgressMessage(msg_data->second);
-      delete msg_data;
-      return FALSE;
-    }, new std::pair<VPNChannelHandler*, std::string>(self, msg)); });
+    self->progress_pipeline_->Push(std::move(msg)); });
 
     defyx_core::EnableVerboseLogs(true);
     return nullptr;
@@ -345,20 +310,72 @@ FlMethodErrorResponse *VPNChannelHandler::ProgressCancel(FlEventChannel *channel
     return nullptr;
 }
 
-void VPNChannelHandler::SetVPNStatus(const std::string &status)
+void VPNChannelHandler::RunBlocking(FlMethodCall *method_call,
+                                    NativeExecutor::Lane lane,
+                                    std::function<MainThreadReply()> work)
 {
-    std::lock_guard<std::mutex> lock(status_mutex_);
-    vpn_status_ = status;
+    std::shared_ptr<FlMethodCall> call(FL_METHOD_CALL(g_object_ref(method_call)), g_object_unref);
+    std::weak_ptr<int> alive = alive_;
+    bool posted = executor_.Post(lane, [call, alive, work = std::move(work)]()
+                                 {
+        MainThreadReply reply;
+        try
+        {
+            reply = work();
+        }
+        catch (...)
+        {
+            reply = [](FlMethodCall *c)
+            { FinishWithError(c, "INTERNAL_ERROR", "Method execution failed"); };
+        }
+        main_thread::Invoke([call, alive, reply = std::move(reply)]()
+                            {
+            if (alive.expired())
+                return;
+            reply(call.get()); }); });
+    if (!posted)
+    {
+        FinishWithError(method_call, "BUSY", "Native executor queue is full");
+    }
 }
 
-void VPNChannelHandler::SendStatus(const std::string &status)
+const char *VPNChannelHandler::StatusName(VpnStatus status)
+{
+    switch (status)
+    {
+    case VpnStatus::kDisconnected:
+        return "disconnected";
+    case VpnStatus::kConnecting:
+        return "connecting";
+    case VpnStatus::kConnected:
+        return "connected";
+    case VpnStatus::kDisconnecting:
+        return "disconnecting";
+    }
+    return "disconnected";
+}
+
+uint64_t VPNChannelHandler::SetVPNStatus(VpnStatus status)
+{
+    uint64_t word = status_word_.load();
+    uint64_t next;
+    do
+    {
+        next = (((word >> 8) + 1) << 8) | static_cast<uint64_t>(status);
+    } while (!status_word_.compare_exchange_weak(word, next));
+    return next >> 8;
+}
+
+void VPNChannelHandler::SendStatus()
 {
     if (!status_listening_ || status_channel_ == nullptr)
     {
         return;
     }
+    uint64_t word = status_word_.load();
     g_autoptr(FlValue) payload = fl_value_new_map();
-    fl_value_set_string_take(payload, "status", fl_value_new_string(status.c_str()));
+    fl_value_set_string_take(payload, "status", fl_value_new_string(StatusName(static_cast<VpnStatus>(word & 0xff))));
+    fl_value_set_string_take(payload, "seq", fl_value_new_int(static_cast<int64_t>(word >> 8)));
     g_autoptr(GError) error = nullptr;
     if (!fl_event_channel_send(status_channel_, payload, nullptr, &error))
     {
@@ -366,13 +383,17 @@ void VPNChannelHandler::SendStatus(const std::string &status)
     }
 }
 
-void VPNChannelHandler::SendProgress(const std::string &message)
+void VPNChannelHandler::SendProgress(const std::vector<std::string> &messages)
 {
-    if (!progress_listening_ || progress_channel_ == nullptr)
+    if (!progress_listening_ || progress_channel_ == nullptr || messages.empty())
     {
         return;
     }
-    g_autoptr(FlValue) value = fl_value_new_string(message.c_str());
+    g_autoptr(FlValue) value = fl_value_new_list();
+    for (const auto &message : messages)
+    {
+        fl_value_append_take(value, fl_value_new_string_sized(message.data(), message.size()));
+    }
     g_autoptr(GError) error = nullptr;
     if (!fl_event_channel_send(progress_channel_, value, nullptr, &error))
     {
@@ -380,20 +401,62 @@ void VPNChannelHandler::SendProgress(const std::string &message)
     }
 }
 
-void VPNChannelHandler::HandleProgressMessage(const std::string &msg)
+void VPNChannelHandler::HandleProgressBatch(std::vector<std::string> &messages)
 {
     if (!is_active_)
         return;
 
-    SendProgress(msg);
+    // Flutter sees the progress lines before the status changes they cause,
+    // as it did when each line was sent on its own.
+    SendProgress(messages);
+    for (const auto &msg : messages)
+    {
+        connection_event::Event event = connection_event::Classify(msg);
+        if (event.code == connection_event::Code::kNone)
+            continue;
+        connect_trace::Instant(connection_event::Name(event.code), "ui");
+        SendEvent(event);
+        HandleConnectionEvent(event);
+    }
+}
 
-    if (msg.find("Data: VPN connected") != std::string::npos)
+void VPNChannelHandler::SendEvent(const connection_event::Event &event)
+{
+    if (!status_listening_ || status_channel_ == nullptr)
     {
-        {
-            std::lock_guard<std::mutex> lock(status_mutex_);
-            vpn_status_ = "connected";
-        }
-        SendStatus(vpn_status_);
+        return;
+    }
+    g_autoptr(FlValue) payload = fl_value_new_map();
+    fl_value_set_string_take(payload, "event", fl_value_new_int(static_cast<int64_t>(event.code)));
+    fl_value_set_string_take(payload, "name", fl_value_new_string(connection_event::Name(event.code)));
+    fl_value_set_string_take(payload, "seq", fl_value_new_int(static_cast<int64_t>(++event_seq_)));
+    fl_value_set_string_take(payload, "ts", fl_value_new_int(g_get_monotonic_time() / 1000));
+    if (event.value >= 0)
+    {
+        fl_value_set_string_take(payload, "value", fl_value_new_int(event.value));
+    }
+    if (!event.text.empty())
+    {
+        fl_value_set_string_take(payload, "text", fl_value_new_string_sized(event.text.data(), event.text.size()));
+    }
+    g_autoptr(GError) error = nullptr;
+    if (!fl_event_channel_send(status_channel_, payload, nullptr, &error))
+    {
+        g_warning("Failed to send connection event: %s", error->message);
+    }
+}
+
+void VPNChannelHandler::HandleConnectionEvent(const connection_event::Event &event)
+{
+    if (!is_active_)
+        return;
+
+    using connection_event::Code;
+    if (event.code == Code::kConnected)
+    {
+        defyx_core::InvalidateResultCache();
+        SetVPNStatus(VpnStatus::kConnected);
+        SendStatus();
 
         if (system_tray_)
         {
@@ -403,8 +466,8 @@ void VPNChannelHandler::HandleProgressMessage(const std::string &msg)
         }
 
         // Apply system proxy if enabled
-        std::thread([this]()
-                    {
+        executor_.Post(NativeExecutor::Lane::kCritical, [this]()
+                       {
       if (!is_active_) return;
       if (system_tray_ && system_tray_->GetSystemProxy()) {
         proxy::ProxyConfig config;
@@ -412,15 +475,13 @@ void VPNChannelHandler::HandleProgressMessage(const std::string &msg)
         config.port = 1080;
         config.scheme = "socks5";
         proxy::ApplySystemProxy(config);
-      } })
-            .detach();
+      }
+      connect_trace::EndSession("connected"); });
     }
-    else if (msg.find("Data: VPN failed") != std::string::npos)
+    else if (event.code == Code::kFailed)
     {
-        {
-            std::lock_guard<std::mutex> lock(status_mutex_);
-            vpn_status_ = "disconnected";
-        }
+        defyx_core::InvalidateResultCache();
+        SetVPNStatus(VpnStatus::kDisconnected);
 
         if (system_tray_)
         {
@@ -429,23 +490,20 @@ void VPNChannelHandler::HandleProgressMessage(const std::string &msg)
             system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Error);
         }
 
-        std::thread([this]()
-                    {
+        executor_.Post(NativeExecutor::Lane::kCritical, [this]()
+                       {
       if (!is_active_) return;
       if (system_tray_ && system_tray_->GetSystemProxy()) {
         proxy::ResetSystemProxy();
-      } })
-            .detach();
+      }
+      connect_trace::EndSession("failed"); });
 
-        SendStatus(vpn_status_);
+        SendStatus();
     }
-    else if (msg.find("Data: VPN stopped") != std::string::npos ||
-             msg.find("Data: VPN cancelled") != std::string::npos)
+    else if (event.code == Code::kStopped || event.code == Code::kCancelled)
     {
-        {
-            std::lock_guard<std::mutex> lock(status_mutex_);
-            vpn_status_ = "disconnected";
-        }
+        defyx_core::InvalidateResultCache();
+        SetVPNStatus(VpnStatus::kDisconnected);
 
         if (system_tray_)
         {
@@ -454,15 +512,15 @@ void VPNChannelHandler::HandleProgressMessage(const std::string &msg)
             system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Connect);
         }
 
-        std::thread([this]()
-                    {
+        executor_.Post(NativeExecutor::Lane::kCritical, [this]()
+                       {
       if (!is_active_) return;
       if (system_tray_ && system_tray_->GetSystemProxy()) {
         proxy::ResetSystemProxy();
-      } })
-            .detach();
+      }
+      connect_trace::EndSession("stopped"); });
 
-        SendStatus(vpn_status_);
+        SendStatus();
     }
 }
 
@@ -477,16 +535,13 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
     {
         if (strcmp(method, "connect") == 0)
         {
-            self->SetVPNStatus("connected");
-            self->SendStatus("connected");
+            self->SetVPNStatus(VpnStatus::kConnected);
+            self->SendStatus();
             FinishWithBool(method_call, true);
         }
         else if (strcmp(method, "disconnect") == 0)
         {
-            {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                self->vpn_status_ = "disconnecting";
-            }
+            self->SetVPNStatus(VpnStatus::kDisconnecting);
 
             if (self->system_tray_)
             {
@@ -495,34 +550,34 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
                 self->system_tray_->UpdateTooltip("DefyxVPN - Disconnecting ...");
             }
 
-            self->SendStatus("disconnecting");
+            self->SendStatus();
 
-            defyx_core::StopVPN();
-            defyx_core::Stop();
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-
-            {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                self->vpn_status_ = "disconnected";
-            }
+            self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [self]()
+                              {
+                defyx_core::StopVPN();
+                defyx_core::Stop();
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return [self](FlMethodCall *call)
+                {
+                    self->SetVPNStatus(VpnStatus::kDisconnected);
 
-            if (self->system_tray_)
-            {
-                self->system_tray_->UpdateIcon(SystemTray::TrayIconStatus::Standby);
-                self->system_tray_->UpdateTooltip("DefyxVPN - Disconnected");
-                self->system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Connect);
-            }
+                    if (self->system_tray_)
+                    {
+                        self->system_tray_->UpdateIcon(SystemTray::TrayIconStatus::Standby);
+                        self->system_tray_->UpdateTooltip("DefyxVPN - Disconnected");
+                        self->system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Connect);
+                    }
 
-            std::thread([self]()
-                        {
+                    self->executor_.Post(NativeExecutor::Lane::kCritical, [self]()
+                                         {
         if (!self->is_active_) return;
         if (self->system_tray_ && self->system_tray_->GetSystemProxy()) {
           proxy::ResetSystemProxy();
-        } })
-                .detach();
+        } });
 
-            self->SendStatus("disconnected");
-            FinishWithBool(method_call, true);
+                    self->SendStatus();
+                    FinishWithBool(call, true);
+                }; });
         }
         else if (strcmp(method, "prepareVPN") == 0 || strcmp(method, "grantVpnPermission") == 0)
         {
@@ -534,36 +589,69 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
         }
         else if (strcmp(method, "getVpnStatus") == 0)
         {
-            std::string status;
-            {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                status = self->vpn_status_;
-            }
-            FinishWithString(method_call, status);
+            FinishWithString(method_call, StatusName(self->GetVPNStatus()));
         }
         else if (strcmp(method, "isTunnelRunning") == 0)
         {
-            std::string status;
+            FinishWithBool(method_call, self->GetVPNStatus() == VpnStatus::kConnected);
+        }
+        else if (strcmp(method, "getStatusSince") == 0)
+        {
+            // Cheap to poll: answers straight away, and only carries the
+            // status when it changed after |seq|.
+            FlValue *args = fl_method_call_get_args(method_call);
+            int64_t since = LookupInt(args, "seq", -1);
+            uint64_t word = self->status_word_.load();
+            int64_t seq = static_cast<int64_t>(word >> 8);
+            bool changed = since < seq;
+            g_autoptr(FlValue) result = fl_value_new_map();
+            fl_value_set_string_take(result, "seq", fl_value_new_int(seq));
+            fl_value_set_string_take(result, "changed", fl_value_new_bool(changed));
+            if (changed)
             {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                status = self->vpn_status_;
+                fl_value_set_string_take(result, "status", fl_value_new_string(StatusName(static_cast<VpnStatus>(word & 0xff))));
             }
-            FinishWithBool(method_call, status == "connected");
+            FinishWithSuccess(method_call, result);
         }
         else if (strcmp(method, "calculatePing") == 0)
         {
-            auto *ping_task = new AsyncPingTask(method_call);
-            std::thread(ExecutePingInBackground, ping_task).detach();
+            // Answered with DEFAULT_PING at the deadline even if the core is
+            // still probing; timeoutMs lets the caller tighten it.
+            FlValue *args = fl_method_call_get_args(method_call);
+            int64_t timeout_ms = LookupInt(args, "timeoutMs", PING_TIMEOUT_MS);
+            if (timeout_ms <= 0 || timeout_ms > PING_TIMEOUT_MS)
+                timeout_ms = PING_TIMEOUT_MS;
+            auto reply = DeadlineReply::Start(method_call, static_cast<guint>(timeout_ms),
+                                              fl_value_new_int(DEFAULT_PING), &g_ping_deadlines);
+            if (!self->executor_.Post(NativeExecutor::Lane::kBackground,
+                                      [reply]()
+                                      { MeasurePingInBackground(reply); }))
+            {
+                DeadlineReply::Complete(reply, fl_value_new_int(DEFAULT_PING));
+            }
         }
         else if (strcmp(method, "getFlag") == 0)
         {
-            auto *flag_task = new AsyncFlagTask(method_call);
-            std::thread(ExecuteFlagInBackground, flag_task).detach();
+            FlValue *args = fl_method_call_get_args(method_call);
+            int64_t timeout_ms = LookupInt(args, "timeoutMs", FLAG_TIMEOUT_MS);
+            if (timeout_ms <= 0 || timeout_ms > FLAG_TIMEOUT_MS)
+                timeout_ms = FLAG_TIMEOUT_MS;
+            auto reply = DeadlineReply::Start(method_call, static_cast<guint>(timeout_ms),
+                                              fl_value_new_string(DEFAULT_FLAG), &g_flag_deadlines);
+            if (!self->executor_.Post(NativeExecutor::Lane::kBackground,
+                                      [reply]()
+                                      { GetFlagInBackground(reply); }))
+            {
+                DeadlineReply::Complete(reply, fl_value_new_string(DEFAULT_FLAG));
+            }
         }
         else if (strcmp(method, "setAsnName") == 0)
         {
-            defyx_core::SetAsnName();
-            FinishWithNull(method_call);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kBackground, []()
+                              {
+                defyx_core::CachedSetAsnName();
+                return [](FlMethodCall *call)
+                { FinishWithNull(call); }; });
         }
         else if (strcmp(method, "setTimezone") == 0)
         {
@@ -571,17 +659,26 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
             std::string tz_string = LookupString(args, "timezone");
             if (!tz_string.empty())
             {
+                float tz = 0;
+                bool parsed = false;
                 try
                 {
-                    float tz = std::stof(tz_string);
-                    defyx_core::SetTimeZone(tz);
-                    FinishWithBool(method_call, true);
-                    return;
+                    tz = std::stof(tz_string);
+                    parsed = true;
                 }
                 catch (...)
                 {
                     // Fall through to error
                 }
+                if (parsed)
+                {
+                    self->RunBlocking(method_call, NativeExecutor::Lane::kBackground, [tz]()
+                                      {
+                        defyx_core::SetTimeZone(tz);
+                        return [](FlMethodCall *call)
+                        { FinishWithBool(call, true); }; });
+                    return;
+                }
             }
             FinishWithError(method_call, "INVALID_ARGUMENT", "timezone missing or invalid");
         }
@@ -589,21 +686,19 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
         {
             FlValue *args = fl_method_call_get_args(method_call);
             std::string is_test_str = LookupString(args, "isTest");
-            std::string flowLine = defyx_core::GetFlowLine();
-            if (flowLine.empty())
-            {
-                flowLine = "{}";
-            }
-            FinishWithString(method_call, flowLine);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kBackground, []()
+                              {
+                auto flowLine = std::make_shared<defyx_core::CoreString>(defyx_core::CachedGetFlowLine());
+                return [flowLine](FlMethodCall *call)
+                { FinishWithString(call, flowLine->empty() ? std::string_view("{}") : flowLine->view()); }; });
         }
         else if (strcmp(method, "getCachedFlowLine") == 0)
         {
-            std::string flowLine = defyx_core::GetCachedFlowLine();
-            if (flowLine.empty())
-            {
-                flowLine = "{}";
-            }
-            FinishWithString(method_call, flowLine);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kBackground, []()
+                              {
+                auto flowLine = std::make_shared<defyx_core::CoreString>(defyx_core::CachedGetCachedFlowLine());
+                return [flowLine](FlMethodCall *call)
+                { FinishWithString(call, flowLine->empty() ? std::string_view("{}") : flowLine->view()); }; });
         }
         else if (strcmp(method, "decodeAndVerifyFlowline") == 0)
         {
@@ -611,8 +706,11 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
             std::string flowLine = LookupString(args, "flowLine");
             if (!flowLine.empty())
             {
-                std::string decodedFlowLine = defyx_core::DecodeAndVerifyFlowline(flowLine);
-                FinishWithString(method_call, decodedFlowLine);
+                self->RunBlocking(method_call, NativeExecutor::Lane::kBackground, [flowLine]()
+                                  {
+                    auto decoded = std::make_shared<defyx_core::CoreString>(defyx_core::CachedDecodeAndVerifyFlowline(flowLine));
+                    return [decoded](FlMethodCall *call)
+                    { FinishWithString(call, decoded->view()); }; });
             }
             else
             {
@@ -625,8 +723,13 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
             std::string method_name = LookupString(args, "method");
             if (!method_name.empty())
             {
-                defyx_core::SetConnectionMethod(method_name);
-                FinishWithBool(method_call, true);
+                // Critical lane, so it is queued ahead of a startVPN that
+                // follows it.
+                self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [method_name]()
+                                  {
+                    defyx_core::SetConnectionMethod(method_name);
+                    return [](FlMethodCall *call)
+                    { FinishWithBool(call, true); }; });
             }
             else
             {
@@ -639,8 +742,13 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
             std::string cache_dir = LookupString(args, "cacheDir");
             if (!cache_dir.empty())
             {
-                defyx_core::SetCacheDir(cache_dir);
-                FinishWithBool(method_call, true);
+                // Called first thing at startup, while the prewarm thread may
+                // still be loading the core; never wait for that here.
+                self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [cache_dir]()
+                                  {
+                    defyx_core::SetCacheDir(cache_dir);
+                    return [](FlMethodCall *call)
+                    { FinishWithBool(call, true); }; });
             }
             else
             {
@@ -649,7 +757,7 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
         }
         else if (strcmp(method, "getSharedDirectory") == 0)
         {
-            FinishWithString(method_call, "/tmp/defyx");
+            FinishWithString(method_call, cache_manager::CoreDir());
         }
         else if (strcmp(method, "startVPN") == 0)
         {
@@ -657,16 +765,12 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
             std::string flow = LookupString(args, "flowLine");
             std::string pattern = LookupString(args, "pattern");
 
-            std::string cache_dir = "/tmp/defyx";
-            std::error_code ec;
-            std::filesystem::create_directories(cache_dir, ec);
-
-            defyx_core::StartVPN(cache_dir, flow, pattern);
+            connect_trace::BeginSession();
+            connect_trace::Instant("startVPN", "ui");
 
-            {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                self->vpn_status_ = "connecting";
-            }
+            // Flip to connecting before the core runs so its own "VPN
+            // connected" progress message can't be overwritten afterwards.
+            self->SetVPNStatus(VpnStatus::kConnecting);
 
             if (self->system_tray_)
             {
@@ -675,14 +779,18 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
                 self->system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Connecting);
             }
 
-            FinishWithBool(method_call, true);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [flow, pattern]()
+                              {
+                std::string cache_dir = cache_manager::CoreDir();
+
+                connect_trace::Span span("core.StartVPN", "core");
+                defyx_core::StartVPN(cache_dir, flow, pattern);
+                return [](FlMethodCall *call)
+                { FinishWithBool(call, true); }; });
         }
         else if (strcmp(method, "stopVPN") == 0)
         {
-            {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                self->vpn_status_ = "disconnecting";
-            }
+            self->SetVPNStatus(VpnStatus::kDisconnecting);
 
             if (self->system_tray_)
             {
@@ -691,25 +799,148 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
                 self->system_tray_->UpdateTooltip("DefyxVPN - Disconnecting ...");
             }
 
-            self->SendStatus("disconnecting");
+            self->SendStatus();
 
-            defyx_core::StopVPN();
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [self]()
+                              {
+                defyx_core::StopVPN();
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return [self](FlMethodCall *call)
+                {
+                    self->SetVPNStatus(VpnStatus::kDisconnected);
 
-            {
-                std::lock_guard<std::mutex> lock(self->status_mutex_);
-                self->vpn_status_ = "disconnected";
-            }
+                    if (self->system_tray_)
+                    {
+                        self->system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Connect);
+                        self->system_tray_->UpdateIcon(SystemTray::TrayIconStatus::Standby);
+                        self->system_tray_->UpdateTooltip("DefyxVPN - Disconnected");
+                    }
 
-            if (self->system_tray_)
+                    self->SendStatus();
+                    FinishWithBool(call, true);
+
+                    // The core is idle now; a good moment to bound its cache.
+                    self->executor_.Post(NativeExecutor::Lane::kBackground, []()
+                                         { cache_manager::TrimAll(); });
+                }; });
+        }
+        else if (strcmp(method, "getNativeLogs") == 0)
+        {
+            FlValue *args = fl_method_call_get_args(method_call);
+            int64_t since_seq = LookupInt(args, "sinceSeq", 0);
+            int64_t max_count = LookupInt(args, "maxCount", 500);
+            int64_t min_level = LookupInt(args, "minLevel", static_cast<int64_t>(defyx_log::Level::kTrace));
+            if (since_seq < 0)
+                since_seq = 0;
+            if (max_count <= 0)
+                max_count = 500;
+            if (min_level < 0 || min_level > static_cast<int64_t>(defyx_log::Level::kError))
+                min_level = static_cast<int64_t>(defyx_log::Level::kTrace);
+
+            uint64_t latest_seq = 0;
+            auto entries = defyx_log::Tail(static_cast<uint64_t>(since_seq),
+                                           static_cast<size_t>(max_count),
+                                           static_cast<defyx_log::Level>(min_level),
+                                           &latest_seq);
+
+            g_autoptr(FlValue) list = fl_value_new_list();
+            for (const auto &entry : entries)
+            {
+                FlValue *item = fl_value_new_map();
+                fl_value_set_string_take(item, "seq", fl_value_new_int(static_cast<int64_t>(entry.seq)));
+                fl_value_set_string_take(item, "ts", fl_value_new_int(entry.timestamp_ms));
+                fl_value_set_string_take(item, "level", fl_value_new_int(static_cast<int64_t>(entry.level)));
+                fl_value_set_string_take(item, "message", fl_value_new_string_sized(entry.text.data(), entry.text.size()));
+                fl_value_append_take(list, item);
+            }
+
+            g_autoptr(FlValue) result = fl_value_new_map();
+            fl_value_set_string(result, "entries", list);
+            fl_value_set_string_take(result, "latestSeq", fl_value_new_int(static_cast<int64_t>(latest_seq)));
+            fl_value_set_string_take(result, "dropped", fl_value_new_int(static_cast<int64_t>(defyx_log::DroppedCount())));
+            FinishWithSuccess(method_call, result);
+        }
+        else if (strcmp(method, "getNativeStats") == 0)
+        {
+            g_autoptr(FlValue) cache = fl_value_new_map();
+            for (const auto &stats : defyx_core::GetResultCacheStats())
+            {
+                FlValue *item = fl_value_new_map();
+                fl_value_set_string_take(item, "hits", fl_value_new_int(static_cast<int64_t>(stats.hits)));
+                fl_value_set_string_take(item, "staleHits", fl_value_new_int(static_cast<int64_t>(stats.stale_hits)));
+                fl_value_set_string_take(item, "misses", fl_value_new_int(static_cast<int64_t>(stats.misses)));
+                fl_value_set_string_take(item, "refreshes", fl_value_new_int(static_cast<int64_t>(stats.refreshes)));
+                fl_value_set_string_take(item, "joined", fl_value_new_int(static_cast<int64_t>(stats.joined)));
+                fl_value_set_string_take(cache, stats.name.c_str(), item);
+            }
+
+            g_autoptr(FlValue) deadlines = fl_value_new_map();
+            fl_value_set_string_take(deadlines, "calculatePing", NewDeadlineStats(g_ping_deadlines));
+            fl_value_set_string_take(deadlines, "getFlag", NewDeadlineStats(g_flag_deadlines));
+
+            g_autoptr(FlValue) progress = fl_value_new_map();
+            if (self->progress_pipeline_)
+            {
+                ProgressPipeline::Stats stats = self->progress_pipeline_->GetStats();
+                fl_value_set_string_take(progress, "pushed", fl_value_new_int(static_cast<int64_t>(stats.pushed)));
+                fl_value_set_string_take(progress, "delivered", fl_value_new_int(static_cast<int64_t>(stats.delivered)));
+                fl_value_set_string_take(progress, "collapsed", fl_value_new_int(static_cast<int64_t>(stats.collapsed)));
+                fl_value_set_string_take(progress, "batches", fl_value_new_int(static_cast<int64_t>(stats.batches)));
+            }
+
+            g_autoptr(FlValue) tiers = fl_value_new_map();
+            for (const auto &stats : cache_manager::Stats())
+            {
+                FlValue *item = fl_value_new_map();
+                fl_value_set_string_take(item, "path", fl_value_new_string(stats.path.c_str()));
+                fl_value_set_string_take(item, "inMemory", fl_value_new_bool(stats.in_memory));
+                fl_value_set_string_take(item, "bytes", fl_value_new_int(static_cast<int64_t>(stats.bytes)));
+                fl_value_set_string_take(item, "files", fl_value_new_int(static_cast<int64_t>(stats.files)));
+                fl_value_set_string_take(item, "limitBytes", fl_value_new_int(static_cast<int64_t>(stats.limit_bytes)));
+                fl_value_set_string_take(item, "evictedFiles", fl_value_new_int(static_cast<int64_t>(stats.evicted_files)));
+                fl_value_set_string_take(item, "evictedBytes", fl_value_new_int(static_cast<int64_t>(stats.evicted_bytes)));
+                fl_value_set_string_take(tiers, stats.name, item);
+            }
+
+            g_autoptr(FlValue) result = fl_value_new_map();
+            fl_value_set_string(result, "resultCache", cache);
+            fl_value_set_string(result, "deadlines", deadlines);
+            fl_value_set_string(result, "progress", progress);
+            fl_value_set_string(result, "cacheTiers", tiers);
+            FinishWithSuccess(method_call, result);
+        }
+        else if (strcmp(method, "dumpConnectTrace") == 0)
+        {
+            FlValue *args = fl_method_call_get_args(method_call);
+            int64_t id = LookupInt(args, "id", 0);
+            FinishWithString(method_call, connect_trace::DumpJson(id > 0 ? static_cast<uint64_t>(id) : 0));
+        }
+        else if (strcmp(method, "reloadCore") == 0)
+        {
+            FlValue *args = fl_method_call_get_args(method_call);
+            std::string path = LookupString(args, "path");
+            // A StartVPN under way would bring its tunnel up inside the core
+            // being replaced, out of reach of stopVPN.
+            if (self->GetVPNStatus() == VpnStatus::kConnecting)
             {
-                self->system_tray_->UpdateConnectionStatus(SystemTray::ConnectionStatus::Connect);
-                self->system_tray_->UpdateIcon(SystemTray::TrayIconStatus::Standby);
-                self->system_tray_->UpdateTooltip("DefyxVPN - Disconnected");
+                FinishWithError(method_call, "BUSY", "Cannot reload the core while connecting");
+                return;
             }
-
-            self->SendStatus("disconnected");
-            FinishWithBool(method_call, true);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [path]()
+                              {
+                std::string error;
+                bool ok = defyx_core::ReloadCoreDll(path, &error);
+                return [ok, error](FlMethodCall *call)
+                {
+                    if (ok)
+                    {
+                        FinishWithBool(call, true);
+                    }
+                    else
+                    {
+                        FinishWithError(call, error.c_str(), "Core reload failed; previous core still in use");
+                    }
+                }; });
         }
         else if (strcmp(method, "isVPNPrepared") == 0)
         {
@@ -750,13 +981,19 @@ void VPNChannelHandler::HandleMethodCall(FlMethodChannel *channel,
             config.port = port;
             config.scheme = scheme.empty() ? "http" : scheme;
             config.no_proxy = no_proxy;
-            bool ok = proxy::ApplySystemProxy(config);
-            FinishWithBool(method_call, ok);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, [config]()
+                              {
+                bool ok = proxy::ApplySystemProxy(config);
+                return [ok](FlMethodCall *call)
+                { FinishWithBool(call, ok); }; });
         }
         else if (strcmp(method, "resetSystemProxy") == 0)
         {
-            proxy::ResetSystemProxy();
-            FinishWithBool(method_call, true);
+            self->RunBlocking(method_call, NativeExecutor::Lane::kCritical, []()
+                              {
+                proxy::ResetSystemProxy();
+                return [](FlMethodCall *call)
+                { FinishWithBool(call, true); }; });
         }
         else
         {
@@ -5,8 +5,13 @@
 #include <functional>
 #include <memory>
 #include <string>
-#include <mutex>
 #include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "connection_event.h"
+#include "native_executor.h"
+#include "progress_pipeline.h"
 
 class SystemTray;
 
@@ -20,12 +25,26 @@ public:
 
     void SetupChannels();
 
-    std::string GetVPNStatus() const { return vpn_status_; }
-    void SetVPNStatus(const std::string &status);
+    enum class VpnStatus : uint8_t
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected,
+        kDisconnecting,
+    };
+    static const char *StatusName(VpnStatus status);
+
+    // Status and its sequence number live in one atomic word, so readers on
+    // any thread always see a matching pair without taking a lock.
+    VpnStatus GetVPNStatus() const { return static_cast<VpnStatus>(status_word_.load() & 0xff); }
+    uint64_t GetStatusSeq() const { return status_word_.load() >> 8; }
+    // Stores |status| under the next sequence number and returns it.
+    uint64_t SetVPNStatus(VpnStatus status);
 
-    void HandleProgressMessage(const std::string &message);
-    void SendStatus(const std::string &status);
-    void SendProgress(const std::string &message);
+    // Sends the current status and its sequence number to listeners.
+    void SendStatus();
+    // Sends a whole batch as one list event.
+    void SendProgress(const std::vector<std::string> &messages);
 
 private:
     static void HandleMethodCall(FlMethodChannel *channel,
@@ -47,12 +66,23 @@ private:
     void SetupStatusChannel();
     void SetupProgressChannel();
     void SetupMethodChannel();
+    void HandleProgressBatch(std::vector<std::string> &messages);
+    // Typed state events go out on the status channel; the raw lines only
+    // on the progress (log) channel.
+    void SendEvent(const connection_event::Event &event);
+    void HandleConnectionEvent(const connection_event::Event &event);
+
+    // Work posted by RunBlocking returns the reply to send once back on the
+    // GTK main thread, where tray and event channel updates are safe.
+    using MainThreadReply = std::function<void(FlMethodCall *)>;
+    void RunBlocking(FlMethodCall *method_call, NativeExecutor::Lane lane,
+                     std::function<MainThreadReply()> work);
 
     FlBinaryMessenger *messenger_;
     SystemTray *system_tray_;
 
-    std::string vpn_status_;
-    std::mutex status_mutex_;
+    // (seq << 8) | VpnStatus; seq 0 is the initial "disconnected".
+    std::atomic<uint64_t> status_word_{static_cast<uint64_t>(VpnStatus::kDisconnected)};
     std::atomic<bool> is_active_{true};
 
     FlMethodChannel *method_channel_;
@@ -61,4 +91,15 @@ private:
 
     bool status_listening_;
     bool progress_listening_;
+    uint64_t event_seq_ = 0;  // main thread only
+
+    // Fed by the core's progress callback, drained on the main thread.
+    std::unique_ptr<ProgressPipeline> progress_pipeline_;
+
+    // Replies queued for the main thread check this before touching the
+    // handler; reset in the destructor.
+    std::shared_ptr<int> alive_ = std::make_shared<int>(0);
+
+    // Runs blocking core and proxy work; joined in the destructor.
+    NativeExecutor executor_{2, 16, 32};
 };